@@ -0,0 +1,34 @@
+#version 330
+
+in vec2 uv;
+in vec3 normal;
+in vec2 splat;
+in vec4 position_camera_space;
+in float fog_alpha;
+
+uniform sampler2D sampler;
+uniform sampler2D sampler2;
+uniform sampler2D sampler3;
+uniform vec3 fog_color = vec3(0.0, 0.0, 1.0);
+uniform vec2 texture_wrap;
+
+out vec4 fragColor;
+
+void main()
+{
+  vec2 nuv = uv * texture_wrap;
+  vec3 n = normalize(normal);
+
+  vec4 t2 = mix(texture(sampler3, nuv), texture(sampler2, nuv), splat.y);
+  vec4 tex = mix(t2, texture(sampler, nuv), splat.x);
+
+  const vec3 light_dir = normalize(vec3(0.2, 1.0, -0.3));
+  float light = clamp(dot(n, light_dir), 0.0, 1.0);
+  float specular_light = clamp(dot(normalize(-position_camera_space.xyz), reflect(-light_dir, n)), 0.0, 1.0);
+
+  fragColor = vec4(0.53, 0.56, 0.58, 1.0) * tex;
+  fragColor += clamp(tex * 1.9 * light * light, vec4(0.0, 0.0, 0.0, 0.0), tex);
+  fragColor += clamp(tex * 0.4 * pow(specular_light, 20.0), vec4(0.0, 0.0, 0.0, 0.0), tex);
+
+  fragColor.rgb = mix(fragColor.rgb, fog_color, fog_alpha);
+}
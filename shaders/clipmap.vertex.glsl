@@ -0,0 +1,74 @@
+#version 330 
+
+#ifdef GL_ES
+  precision highp float;
+#endif
+
+uniform mat4 M; 
+uniform mat4 V; 
+uniform mat4 P; 
+
+// heights of every level in a layer, texel c mod texture_size holds the grid coordinate c
+uniform sampler2DArray heights;
+uniform float texture_size = 68.0;
+uniform float level_size = 64.0;
+// first vertex on the grid of the level and the index of the level
+uniform vec3 level_origin;
+uniform float level_spacing = 10.0;
+uniform float unit = 10.0;
+
+uniform float fog_scattering = 1.0;
+uniform float fog_extinction = 0.0001;
+
+uniform float stones_factor = 2.0f;
+uniform float grass_factor = 32.0f;
+uniform float stones_blur = 20.0f;
+uniform float grass_blur = 32.0f;
+
+in vec2 vertex_grid; // corner x, z inside of the level
+
+out vec2 uv;
+out vec3 normal;
+out vec2 splat; // weights of the stones and grass textures
+out vec4 position_camera_space;
+out float fog_alpha;
+
+float height_at(ivec2 c)
+{
+  // % is undefined for negative operands
+  ivec2 texel = c - int(texture_size) * ivec2(floor(vec2(c) / texture_size));
+  return texelFetch(heights, ivec3(texel, int(level_origin.z)), 0).r;
+}
+
+void main()
+{
+  ivec2 c = ivec2(level_origin.xy) + ivec2(vertex_grid);
+  float y = height_at(c);
+
+  // close to the border the level turns into the coarser one, vertices missing from it move onto its edges
+  vec2 d = abs(vertex_grid - vec2(level_size * 0.5)) / (level_size * 0.5);
+  float morph = clamp((max(d.x, d.y) - 0.7) / 0.25, 0.0, 1.0);
+  ivec2 odd = c & 1;
+  if (odd.x + odd.y > 0)
+    y = mix(y, (height_at(c - odd) + height_at(c + odd)) * 0.5, morph);
+
+  vec4 position_model_space = M * vec4(vec2(c).x * level_spacing, y, vec2(c).y * level_spacing, 1.0);
+  position_camera_space = V * position_model_space;
+  gl_Position = P * position_camera_space;
+  // same repetition of the textures as the chunks
+  uv = vec2(c) * (level_spacing / unit);
+
+  normal = normalize(vec3(
+    height_at(c - ivec2(1, 0)) - height_at(c + ivec2(1, 0)),
+    2.0 * level_spacing,
+    height_at(c - ivec2(0, 1)) - height_at(c + ivec2(0, 1))));
+  splat = vec2(clamp((y + stones_factor) / stones_blur, 0.0, 1.0), clamp((grass_factor + y) / grass_blur, 0.0, 1.0));
+
+  float dst = length(position_camera_space);
+  fog_alpha = fog_scattering * exp(-position_model_space.y * fog_extinction) *
+              (1.0f - exp(-dst * normalize(position_camera_space).y * fog_extinction)) /
+              normalize(position_camera_space).y;
+  fog_alpha = clamp(fog_alpha, 0.0, 0.99);
+
+  gl_Position.y += dst*dst / 10000000.0;
+}
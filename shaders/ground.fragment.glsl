@@ -1,68 +1,45 @@
 #version 330
 
 in vec2 uv;
-in vec3 normal;
-in vec4 position_model_space;
+in vec2 surface_uv;
 in vec4 position_camera_space;
-
-float rand(vec2 n) { return fract(sin(dot(n, vec2(12.9898, 4.1414))) * 43758.5453); }
-
-float noise(vec2 p)
-{
-  vec2 ip = floor(p);
-  vec2 u = fract(p);
-  u = u * u * (3.0 - 2.0 * u);
-
-  float res = mix(
-    mix(rand(ip), rand(ip + vec2(1.0, 0.0)), u.x), mix(rand(ip + vec2(0.0, 1.0)), rand(ip + vec2(1.0, 1.0)), u.x), u.y);
-  return res * res;
-}
+in float fog_alpha;
 
 uniform sampler2D sampler;
 uniform sampler2D sampler2;
 uniform sampler2D sampler3;
+// normal in RG and the stones and grass weights in BA baked per chunk
+uniform sampler2D surface;
 uniform vec3 fog_color = vec3(0.0, 0.0, 1.0);
-uniform float fog_scattering = 1.0;
-uniform float fog_extinction = 0.0001;
 uniform vec2 texture_wrap;
 
-uniform float stones_factor = 2.0f;
-uniform float grass_factor = 32.0f;
-
-uniform float stones_blur = 20.0f;
-uniform float grass_blur = 32.0f;
-
 out vec4 fragColor;
 
+vec3 decode_octahedral(vec2 e)
+{
+  vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+  float t = max(-n.y, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.z += n.z >= 0.0 ? -t : t;
+  return normalize(n);
+}
+
 void main()
 {
   vec2 nuv = uv * texture_wrap;
-  float dst = length(position_camera_space);
+  vec4 s = texture(surface, surface_uv);
+  vec3 normal = decode_octahedral(s.rg * 2.0 - 1.0);
 
-  float e = clamp((grass_factor + position_model_space.y) / grass_blur, 0.0, 1.0);
-  vec4 t1 = texture(sampler, nuv);
-  vec4 t2 = texture(sampler2, nuv) * e + (1.0 - e) * texture(sampler3, nuv);
-  e = clamp((position_model_space.y + stones_factor) / stones_blur, 0.0, 1.0);
-  vec4 tex = t1 * e + t2 * (1.0 - e);
+  vec4 t2 = mix(texture(sampler3, nuv), texture(sampler2, nuv), s.a);
+  vec4 tex = mix(t2, texture(sampler, nuv), s.b);
 
   const vec3 light_dir = normalize(vec3(0.2, 1.0, -0.3));
-  float light = clamp(dot(normalize(normal), light_dir), 0.0, 1.0);
+  float light = clamp(dot(normal, light_dir), 0.0, 1.0);
   float specular_light = clamp(dot(normalize(-position_camera_space.xyz), reflect(-light_dir, normal)), 0.0, 1.0);
 
-  fragColor = vec4(0.0, 0.0, 0.0, 1.0);
   fragColor = vec4(0.53, 0.56, 0.58, 1.0) * tex;
   fragColor += clamp(tex * 1.9 * light * light, vec4(0.0, 0.0, 0.0, 0.0), tex);
   fragColor += clamp(tex * 0.4 * pow(specular_light, 20.0), vec4(0.0, 0.0, 0.0, 0.0), tex);
 
-  if (dst < 100.0)
-  {
-    float noise_value = clamp(0.1 / dst, 0.0, 1.0);
-    fragColor.rgb += noise(nuv * 12334.5232) * noise_value;
-  }
-
-  float fog_alpha = fog_scattering * exp(-position_model_space.y * fog_extinction) *
-                    (1.0f - exp(-dst * normalize(position_camera_space).y * fog_extinction)) /
-                    normalize(position_camera_space).y;
-
-  fragColor.rgb = mix(fragColor.rgb, fog_color, clamp(fog_alpha, 0.0, 0.99));
+  fragColor.rgb = mix(fragColor.rgb, fog_color, fog_alpha);
 }
@@ -8,23 +8,51 @@ uniform mat4 M;
 uniform mat4 V; 
 uniform mat4 P; 
 
-in vec3 position;
-in vec2 vertex_uv;
-in vec3 vertex_normal;
+// first corner of the chunk in grid units and the base of its quantized heights
+uniform vec3 chunk_origin;
+uniform float height_scale = 1.0;
+uniform float unit = 10.0;
+// texels along a side of the surface texture, one per corner
+uniform float surface_size = 33.0;
+
+// detail level of the chunk and how far it is morphed into the next one
+uniform float lod_level = 0.0;
+uniform float lod_morph = 0.0;
+
+uniform float fog_scattering = 1.0;
+uniform float fog_extinction = 0.0001;
+
+in vec4 vertex_grid; // corner x, z inside of the chunk, level
+in vec2 vertex_height; // quantized height and morph target
 
 out vec2 uv;
-out vec3 normal;
-out vec4 position_model_space;
+out vec2 surface_uv;
 out vec4 position_camera_space;
+out float fog_alpha;
 
 void main()
 {
-  position_model_space = M * vec4(position, 1.0);
+  vec2 grid = chunk_origin.xz + vertex_grid.xy;
+  float y = chunk_origin.y + vertex_height.x * height_scale;
+
+  // only the vertices missing from the next level move
+  if (abs(vertex_grid.z - lod_level) < 0.5)
+    y = mix(y, chunk_origin.y + vertex_height.y * height_scale, lod_morph);
+
+  vec4 position_model_space = M * vec4(grid.x * unit, y, grid.y * unit, 1.0);
   position_camera_space = V * position_model_space;
   gl_Position = P * position_camera_space;
-  normal = vertex_normal;
-  uv = vertex_uv;
+  // uv in grid units repeats the textures every quad
+  uv = grid;
+  // texel centers are at the corners
+  surface_uv = (vertex_grid.xy + 0.5) / surface_size;
 
   float dst = length(position_camera_space);
+  // fog changes slowly over the surface, it is interpolated from the vertices
+  fog_alpha = fog_scattering * exp(-position_model_space.y * fog_extinction) *
+              (1.0f - exp(-dst * normalize(position_camera_space).y * fog_extinction)) /
+              normalize(position_camera_space).y;
+  fog_alpha = clamp(fog_alpha, 0.0, 0.99);
+
   gl_Position.y += dst*dst / 10000000.0;
 }
@@ -0,0 +1,155 @@
+#include "cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+uint64_t cache_key(
+  const ConfigKeysValues &world_config,
+  const std::vector<std::shared_ptr<ConfigKeysValues>> &props_config,
+  const std::vector<std::shared_ptr<ConfigKeysValues>> &layers_config,
+  const int seed)
+{
+  uint64_t hash = 14695981039346656037ull;
+  const auto add = [&hash](const std::string &text) {
+    for (const char ch : text)
+    {
+      hash ^= static_cast<unsigned char>(ch);
+      hash *= 1099511628211ull;
+    }
+    // separator so that "ab" + "c" differs from "a" + "bc"
+    hash ^= 0xff;
+    hash *= 1099511628211ull;
+  };
+
+  // the sections are unordered maps
+  const auto add_section = [&add](const ConfigKeysValues &section) {
+    std::vector<std::pair<std::string, std::string>> entries(section.begin(), section.end());
+    std::sort(entries.begin(), entries.end());
+    for (const auto &[key, value] : entries)
+    {
+      add(key);
+      add(value);
+    }
+  };
+
+  add(std::to_string(CACHE_VERSION));
+  add(std::to_string(seed));
+  add_section(world_config);
+  // props are placed by the index of their section
+  for (const auto &prop_config : props_config)
+  {
+    add("[Prop]");
+    add_section(*prop_config);
+  }
+  // layers are combined in order
+  for (const auto &layer_config : layers_config)
+  {
+    add("[Layer]");
+    add_section(*layer_config);
+  }
+  return hash;
+}
+
+std::optional<MappedFile> MappedFile::open(const std::filesystem::path &path)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return std::nullopt;
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+  {
+    close(fd);
+    return std::nullopt;
+  }
+
+  const size_t size = file_stat.st_size;
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return std::nullopt;
+
+  return MappedFile(data, size);
+}
+
+MappedFile::MappedFile(MappedFile &&other)
+: data { std::exchange(other.data, nullptr) }
+, size { std::exchange(other.size, 0) }
+{
+}
+
+MappedFile::~MappedFile()
+{
+  if (data)
+    munmap(data, size);
+}
+
+CacheWriter::CacheWriter(const uint32_t magic, const uint64_t key)
+{
+  write(magic);
+  write(CACHE_VERSION);
+  write(key);
+}
+
+void CacheWriter::write_bytes(const void *bytes, const size_t size)
+{
+  const auto *begin = static_cast<const std::byte *>(bytes);
+  buffer.insert(buffer.end(), begin, begin + size);
+}
+
+bool CacheWriter::save(const std::filesystem::path &path) const
+{
+  // unique per thread, chunks are saved by the workers generating them
+  std::filesystem::path temporary = path;
+  temporary += ".tmp" + std::to_string(std::hash<std::thread::id> {}(std::this_thread::get_id()));
+
+  FILE *file = fopen(temporary.c_str(), "wb");
+  if (!file)
+    return false;
+
+  const bool written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+  if (fclose(file) != 0 || !written)
+  {
+    std::filesystem::remove(temporary);
+    return false;
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporary, path, error);
+  return !error;
+}
+
+std::optional<CacheReader> CacheReader::open(const std::filesystem::path &path, const uint32_t magic, const uint64_t key)
+{
+  auto file = MappedFile::open(path);
+  if (!file)
+    return std::nullopt;
+
+  CacheReader reader(std::move(*file), 0);
+  uint32_t file_magic, file_version;
+  uint64_t file_key;
+  if (!reader.read(file_magic) || !reader.read(file_version) || !reader.read(file_key))
+    return std::nullopt;
+  if (file_magic != magic || file_version != CACHE_VERSION || file_key != key)
+    return std::nullopt;
+
+  return reader;
+}
+
+bool CacheReader::read_bytes(void *bytes, const size_t size)
+{
+  const auto file_bytes = file.get_bytes();
+  if (size > file_bytes.size() - offset)
+    return false;
+
+  std::memcpy(bytes, file_bytes.data() + offset, size);
+  offset += size;
+  return true;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "config.hpp"
+
+// bumped whenever the layout or the contents of any of the cached files change
+static constexpr uint32_t CACHE_VERSION { 5 };
+
+constexpr uint32_t cache_magic(const char (&tag)[5])
+{
+  return static_cast<uint32_t>(tag[0]) | static_cast<uint32_t>(tag[1]) << 8 | static_cast<uint32_t>(tag[2]) << 16 |
+         static_cast<uint32_t>(tag[3]) << 24;
+}
+
+// FNV-1a of the sorted keys and values of the World, Prop and Layer sections together with the seed,
+// files of worlds generated with other parameters end up in other directories
+uint64_t cache_key(
+  const ConfigKeysValues &world_config,
+  const std::vector<std::shared_ptr<ConfigKeysValues>> &props_config,
+  const std::vector<std::shared_ptr<ConfigKeysValues>> &layers_config,
+  const int seed);
+
+// read-only mapping of a whole file
+class MappedFile final
+{
+public:
+  static std::optional<MappedFile> open(const std::filesystem::path &path);
+
+  MappedFile(MappedFile &&other);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  inline std::span<const std::byte> get_bytes() const { return { static_cast<const std::byte *>(data), size }; }
+
+private:
+  MappedFile(void *data, const size_t size)
+  : data { data }
+  , size { size }
+  {
+  }
+
+  void *data { nullptr };
+  size_t size { 0 };
+};
+
+// builds a cache file in memory and saves it at once
+class CacheWriter final
+{
+public:
+  CacheWriter(const uint32_t magic, const uint64_t key);
+
+  template<typename T>
+  void write(const T &value)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    write_bytes(&value, sizeof(T));
+  }
+
+  template<typename T>
+  void write(const std::vector<T> &values)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    write_bytes(values.data(), values.size() * sizeof(T));
+  }
+
+  // written to a temporary file first so readers never see a partial file
+  bool save(const std::filesystem::path &path) const;
+
+private:
+  void write_bytes(const void *bytes, const size_t size);
+
+  std::vector<std::byte> buffer;
+};
+
+// reads values in the order they were written by the CacheWriter straight from the mapped file
+class CacheReader final
+{
+public:
+  // nullopt for missing files and files of another kind, version or key
+  static std::optional<CacheReader> open(const std::filesystem::path &path, const uint32_t magic, const uint64_t key);
+
+  template<typename T>
+  [[nodiscard]] bool read(T &value)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    return read_bytes(&value, sizeof(T));
+  }
+
+  template<typename T>
+  [[nodiscard]] bool read(std::vector<T> &values, const size_t count)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (count > (file.get_bytes().size() - offset) / sizeof(T))
+      return false;
+    values.resize(count);
+    return read_bytes(values.data(), count * sizeof(T));
+  }
+
+  // whole file was read
+  inline bool at_end() const { return offset == file.get_bytes().size(); }
+
+private:
+  CacheReader(MappedFile &&file, const size_t offset)
+  : file { std::move(file) }
+  , offset { offset }
+  {
+  }
+
+  bool read_bytes(void *bytes, const size_t size);
+
+  MappedFile file;
+  size_t offset { 0 };
+};
@@ -0,0 +1,175 @@
+#include "clipmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static inline ssize_t floor_mod(const ssize_t a, const ssize_t b)
+{
+  const ssize_t m = a % b;
+  return m < 0 ? m + b : m;
+}
+
+GroundClipmap::GroundClipmap(std::shared_ptr<const TerrainField> terrain, const size_t levels, const ssize_t size)
+: terrain { std::move(terrain) }
+, size { std::clamp<ssize_t>((size + 3) / 4 * 4, 8, 252) }
+, texture_size { this->size + 4 }
+, levels(std::max<size_t>(1, levels))
+{
+  // local corners of a level, shared by all of them
+  const ssize_t corners = this->size + 1;
+  std::vector<uint16_t> vertices;
+  vertices.reserve(corners * corners * 2);
+  for (ssize_t j = 0; j < corners; j++)
+    for (ssize_t i = 0; i < corners; i++)
+      vertices.insert(vertices.end(), { static_cast<uint16_t>(i), static_cast<uint16_t>(j) });
+
+  glGenBuffers(1, &vertex_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(uint16_t), vertices.data(), GL_STATIC_DRAW);
+
+  // same diagonal as the chunks so that the morph targets lie on the edges of the coarser level
+  const auto grid = [this, corners](const ssize_t hole_x, const ssize_t hole_z) {
+    const ssize_t hole = this->size / 2;
+    std::vector<GLuint> indices;
+    for (ssize_t j = 0; j < this->size; j++)
+      for (ssize_t i = 0; i < this->size; i++)
+      {
+        if (i >= hole_x && i < hole_x + hole && j >= hole_z && j < hole_z + hole)
+          continue;
+        const GLuint v00 = j * corners + i;
+        const GLuint v10 = v00 + 1;
+        const GLuint v01 = v00 + corners;
+        const GLuint v11 = v01 + 1;
+        indices.insert(indices.end(), { v11, v10, v00, v00, v01, v11 });
+      }
+    return indices;
+  };
+  full_indices.upload(grid(-this->size, -this->size), {});
+  for (size_t variant = 0; variant < ring_indices.size(); variant++)
+    ring_indices[variant].upload(grid(this->size / 4 + (variant & 1), this->size / 4 + (variant >> 1)), {});
+
+  glGenTextures(1, &heights_texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, heights_texture);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage3D(
+    GL_TEXTURE_2D_ARRAY, 0, GL_R32F, texture_size, texture_size, this->levels.size(), 0, GL_RED, GL_FLOAT, nullptr);
+}
+
+GroundClipmap::~GroundClipmap()
+{
+  glDeleteBuffers(1, &vertex_buffer);
+  glDeleteTextures(1, &heights_texture);
+}
+
+void GroundClipmap::update(const glm::vec3 &camera)
+{
+  texels_updated = 0;
+  for (size_t l = 0; l < levels.size(); l++)
+  {
+    Level &level = levels[l];
+    // snapped to the grid of the coarser level so the border of the level lies on its vertices
+    const float spacing = terrain->UNIT * static_cast<float>(1 << l);
+    level.origin_x = static_cast<ssize_t>(std::floor(camera.x / (spacing * 2.0f))) * 2 - size / 2;
+    level.origin_z = static_cast<ssize_t>(std::floor(camera.z / (spacing * 2.0f))) * 2 - size / 2;
+    if (l > 0)
+    {
+      // the finer level starts a quarter or a quarter and a cell into this one
+      const Level &finer = levels[l - 1];
+      const ssize_t offset_x = finer.origin_x / 2 - level.origin_x - size / 4;
+      const ssize_t offset_z = finer.origin_z / 2 - level.origin_z - size / 4;
+      level.ring = static_cast<size_t>(offset_x) | static_cast<size_t>(offset_z) << 1;
+    }
+
+    // the morph and the normals read a texel around the level
+    const std::pair<ssize_t, ssize_t> window { level.origin_x - 1, level.origin_z - 1 };
+    if (level.window == window)
+      continue;
+
+    if (
+      !level.window || std::abs(window.first - level.window->first) >= texture_size ||
+      std::abs(window.second - level.window->second) >= texture_size)
+    {
+      upload_heights(l, window.first, window.second, texture_size, texture_size);
+      level.window = window;
+      continue;
+    }
+
+    // columns and then rows that came into view, the texels that went out of it are overwritten
+    const auto [old_x, old_z] = *level.window;
+    if (window.first > old_x)
+      upload_heights(l, old_x + texture_size, window.second, window.first - old_x, texture_size);
+    else if (window.first < old_x)
+      upload_heights(l, window.first, window.second, old_x - window.first, texture_size);
+    if (window.second > old_z)
+      upload_heights(l, window.first, old_z + texture_size, texture_size, window.second - old_z);
+    else if (window.second < old_z)
+      upload_heights(l, window.first, window.second, texture_size, old_z - window.second);
+    level.window = window;
+  }
+}
+
+void GroundClipmap::upload_heights(
+  const size_t level, const ssize_t x0, const ssize_t z0, const ssize_t w, const ssize_t h)
+{
+  const float spacing = terrain->UNIT * static_cast<float>(1 << level);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, heights_texture);
+
+  std::vector<float> x, z, heights;
+  // a coordinate c lives in the texel c mod texture_size
+  for (ssize_t bz = z0; bz < z0 + h;)
+  {
+    const ssize_t tz = floor_mod(bz, texture_size);
+    const ssize_t pz = std::min(z0 + h - bz, texture_size - tz);
+    for (ssize_t bx = x0; bx < x0 + w;)
+    {
+      const ssize_t tx = floor_mod(bx, texture_size);
+      const ssize_t px = std::min(x0 + w - bx, texture_size - tx);
+
+      x.resize(px * pz);
+      z.resize(px * pz);
+      heights.resize(px * pz);
+      for (ssize_t j = 0; j < pz; j++)
+        for (ssize_t i = 0; i < px; i++)
+        {
+          x[j * px + i] = static_cast<float>(bx + i) * spacing;
+          z[j * px + i] = static_cast<float>(bz + j) * spacing;
+        }
+      terrain->get_y_batch(x, z, heights);
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, tx, tz, level, px, pz, 1, GL_RED, GL_FLOAT, heights.data());
+      texels_updated += heights.size();
+      bx += px;
+    }
+    bz += pz;
+  }
+}
+
+void GroundClipmap::draw(ZD::ShaderProgram &shader, const GLuint heights_unit) const
+{
+  glActiveTexture(GL_TEXTURE0 + heights_unit);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, heights_texture);
+  glActiveTexture(GL_TEXTURE0);
+  shader.set_uniform<int>("heights", heights_unit);
+  shader.set_uniform<float>("level_size", static_cast<float>(size));
+  shader.set_uniform<float>("texture_size", static_cast<float>(texture_size));
+
+  const auto grid_attribute = shader.get_attribute("vertex_grid");
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+  glEnableVertexAttribArray(grid_attribute->index);
+  glVertexAttribPointer(grid_attribute->index, 2, GL_UNSIGNED_SHORT, GL_FALSE, 2 * sizeof(uint16_t), (void *)0);
+
+  for (size_t l = 0; l < levels.size(); l++)
+  {
+    const Level &level = levels[l];
+    const GroundIndices &indices = l == 0 ? full_indices : ring_indices[level.ring];
+    shader.set_uniform<glm::vec3>(
+      "level_origin",
+      glm::vec3 { static_cast<float>(level.origin_x), static_cast<float>(level.origin_z), static_cast<float>(l) });
+    shader.set_uniform<float>("level_spacing", terrain->UNIT * static_cast<float>(1 << l));
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.get_buffer());
+    glDrawElements(GL_TRIANGLES, indices.get_count(false), GL_UNSIGNED_INT, (void *)0);
+  }
+
+  glDisableVertexAttribArray(grid_attribute->index);
+}
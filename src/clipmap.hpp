@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "ZD/Shader.hpp"
+#include "ZD/3rd/glm/glm.hpp"
+
+#include "ground.hpp"
+#include "terrain.hpp"
+
+// geometry clipmap, nested square grids of the same number of cells centred on the camera,
+// every next level has twice the spacing of the previous one and a hole where the previous one lies
+//
+// heights of every level live in a layer of a texture array addressed toroidally,
+// when the camera moves only the rows and columns that came into view are evaluated and uploaded,
+// so a frame costs the same number of triangles and draw calls however large the world is
+class GroundClipmap final
+{
+public:
+  // the size in cells is rounded up to a multiple of 4 so the holes stay aligned to the coarser grids
+  GroundClipmap(std::shared_ptr<const TerrainField> terrain, const size_t levels, const ssize_t size);
+  GroundClipmap(const GroundClipmap &) = delete;
+  GroundClipmap &operator=(const GroundClipmap &) = delete;
+  ~GroundClipmap();
+
+  // moves the levels with the camera and streams the heights that came into view
+  void update(const glm::vec3 &camera);
+  // the shader is expected to be in use with the uniforms shared by all levels set
+  void draw(ZD::ShaderProgram &shader, const GLuint heights_unit) const;
+
+  inline size_t get_levels_count() const { return levels.size(); }
+  inline size_t get_triangles_count() const
+  {
+    return (full_indices.get_count(false) + ring_indices[0].get_count(false) * (levels.size() - 1)) / 3;
+  }
+  inline size_t get_texels_updated() const { return texels_updated; }
+  inline float get_extent() const { return size * terrain->UNIT * static_cast<float>(1 << (levels.size() - 1)); }
+
+private:
+  struct Level
+  {
+    ssize_t origin_x { 0 }, origin_z { 0 }; // first vertex on the grid of the level
+    std::optional<std::pair<ssize_t, ssize_t>> window; // first coordinates resident in the texture
+    size_t ring { 0 }; // variant of the ring around the finer level
+  };
+
+  // evaluates and uploads the heights of a rectangle of level coordinates, split where the texture wraps
+  void upload_heights(const size_t level, const ssize_t x0, const ssize_t z0, const ssize_t w, const ssize_t h);
+
+  std::shared_ptr<const TerrainField> terrain;
+  const ssize_t size; // cells along a side of every level
+  const ssize_t texture_size; // the cells with a border of texels for the morph and normals
+  std::vector<Level> levels;
+
+  GLuint vertex_buffer { 0 };
+  GLuint heights_texture { 0 };
+  GroundIndices full_indices; // the finest level has no hole
+  std::array<GroundIndices, 4> ring_indices; // the hole is offset by a cell along x and z in the other variants
+  size_t texels_updated { 0 };
+};
@@ -24,7 +24,8 @@ Config::Config(const std::string file_name)
   enum
   {
     World,
-    Prop
+    Prop,
+    Layer
   } section = World;
 
   const auto set_section = [&section](std::string &k) {
@@ -32,6 +33,8 @@ Config::Config(const std::string file_name)
       section = World;
     else if (k.starts_with('P'))
       section = Prop;
+    else if (k.starts_with('L'))
+      section = Layer;
 
     k = "";
   };
@@ -45,6 +48,8 @@ Config::Config(const std::string file_name)
       world_config->insert({ key, value });
     else if (section == Prop)
       props_config.back()->insert({ key, value });
+    else if (section == Layer)
+      layers_config.back()->insert({ key, value });
   };
 
   char ch;
@@ -75,6 +80,8 @@ Config::Config(const std::string file_name)
 
           if (section == Prop)
             props_config.push_back(std::make_shared<ConfigKeysValues>());
+          else if (section == Layer)
+            layers_config.push_back(std::make_shared<ConfigKeysValues>());
         }
         else
           key += ch;
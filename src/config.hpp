@@ -55,9 +55,12 @@ public:
   Config(const std::string file_name);
   inline std::vector<std::shared_ptr<ConfigKeysValues>> get_props_config() const { return props_config; }
   inline std::shared_ptr<ConfigKeysValues> get_world_config() const { return world_config; }
+  // noise layers of the terrain in the order of the sections
+  inline std::vector<std::shared_ptr<ConfigKeysValues>> get_layers_config() const { return layers_config; }
 
 private:
   const std::string file_name;
   std::vector<std::shared_ptr<ConfigKeysValues>> props_config;
+  std::vector<std::shared_ptr<ConfigKeysValues>> layers_config;
   std::shared_ptr<ConfigKeysValues> world_config;
 };
@@ -3,6 +3,12 @@
 
 #include "mech.hpp"
 #include "ground.hpp"
+#include "clipmap.hpp"
+#include "noise.hpp"
+#include "world.hpp"
+
+#include <chrono>
+#include <random>
 
 std::vector<std::pair<std::string, std::pair<glm::vec3, glm::vec3>>> Debug::lines;
 std::vector<std::pair<std::string, glm::vec3>> Debug::cubes;
@@ -67,15 +73,12 @@ void Debug::mech_properties_rotation(Mech &mech)
       mech.get_rotation().z,
       mech.get_rotation().w);
     // legs info
-    for (size_t i = 0; i < mech.legs_b.size(); i++)
+    for (size_t i = 0; i < mech.legs.size(); i++)
     {
       ImGui::PushID(i * 1000 + 0);
-      LegPart &b = *mech.legs_b[i];
-      const auto brot = b.get_rotation();
-      LegPart &m = *mech.legs_m[i];
-      const auto mrot = m.get_rotation();
-      LegPart &e = *mech.legs_e[i];
-      const auto erot = e.get_rotation();
+      const auto brot = mech.legs.parts[0].get_rotation(i);
+      const auto mrot = mech.legs.parts[1].get_rotation(i);
+      const auto erot = mech.legs.parts[2].get_rotation(i);
 
       ImGui::Text("Leg %lu.", i);
       ImGui::Text("Beginning ");
@@ -110,33 +113,33 @@ void Debug::mech_properties_rotation(Mech &mech)
     mech.set_rotation(euler);
     ImGui::Columns();
 
-    for (size_t i = 0; i < mech.legs_b.size(); i++)
+    for (size_t i = 0; i < mech.legs.size(); i++)
     {
       ImGui::PushID(i * 1000 + 0);
 
-      LegPart &b = *mech.legs_b[i];
-      LegPart &m = *mech.legs_m[i];
-      LegPart &e = *mech.legs_e[i];
+      const LegChains::Part &b = mech.legs.parts[0];
+      const LegChains::Part &m = mech.legs.parts[1];
+      const LegChains::Part &e = mech.legs.parts[2];
 
       ImGui::Text("Leg %lu.", i);
 
       ImGui::Text("Beginning ");
       ImGui::SameLine();
-      euler = glm::eulerAngles(glm::normalize(b.get_rotation()));
+      euler = glm::eulerAngles(glm::normalize(b.get_rotation(i)));
       ImGui::Text("% -6.4f, % -6.4f, % -6.4f", euler.x, euler.y, euler.z);
 
       ImGui::PushID(i * 1000 + 1);
 
       ImGui::Text("Middle   ");
       ImGui::SameLine();
-      euler = glm::eulerAngles(glm::normalize(m.get_rotation()));
+      euler = glm::eulerAngles(glm::normalize(m.get_rotation(i)));
       ImGui::Text("% -6.4f, % -6.4f, % -6.4f", euler.x, euler.y, euler.z);
 
       ImGui::PushID(i * 1000 + 2);
 
       ImGui::Text("End      ");
       ImGui::SameLine();
-      euler = glm::eulerAngles(glm::normalize(e.get_rotation()));
+      euler = glm::eulerAngles(glm::normalize(e.get_rotation(i)));
       ImGui::Text("% -6.4f, % -6.4f, % -6.4f", euler.x, euler.y, euler.z);
 
       ImGui::Separator();
@@ -182,6 +185,18 @@ void Debug::mech_properties_legs(Mech &mech)
   float_drag_buttons("Next Step Distance", mech.legs_next_step_distance, 0.1f, 0.0f, 10.0f);
   ImGui::Separator();
 
+  // paths use a cost layer derived for the profile, changing it does not regenerate the map
+  float_drag_buttons("Normal Cost Factor", mech.cost_profile.normal_factor, 0.1f, 0.0f, 20.0f);
+  ImGui::Separator();
+
+  ImGui::Text("IK Solver:");
+  ImGui::SameLine();
+  if (ImGui::RadioButton("Rotate Toward", mech.ik_solver == LegSolverMethod::RotateToward))
+    mech.ik_solver = LegSolverMethod::RotateToward;
+  ImGui::SameLine();
+  if (ImGui::RadioButton("FABRIK", mech.ik_solver == LegSolverMethod::FABRIK))
+    mech.ik_solver = LegSolverMethod::FABRIK;
+
   ImGui::PushID("LegsIKIterations");
   static int ik_iterations = mech.ik_iterations;
   ImGui::DragInt("IK Iterations", &ik_iterations, 1, 1, 200);
@@ -196,23 +211,54 @@ void Debug::mech_properties_legs(Mech &mech)
     ik_iterations = 1;
   mech.ik_iterations = static_cast<size_t>(ik_iterations);
   ImGui::PopID();
+  ImGui::DragFloat("IK Position Tolerance", &mech.ik_position_tolerance, 1e-4f, 0.0f, 1.0f, "%.5f");
+  ImGui::DragFloat("IK Rotation Tolerance", &mech.ik_rotation_tolerance, 1e-5f, 0.0f, 0.1f, "%.6f");
+  ImGui::Text("Average iterations: %.2f / %lu", mech.ik_average_iterations, mech.ik_iterations);
 
   ImGui::Separator();
   float_drag_buttons("Rotation Speed", mech.legs_rotation_speed, 0.001f, 0.0f, 1.0f);
   ImGui::Separator();
 
-  auto rotation_scalar_checkbox = [](auto &leg) {
-    bool lock_x = leg.rotation_scalar.x == 0.0f;
-    bool lock_y = leg.rotation_scalar.y == 0.0f;
-    bool lock_z = leg.rotation_scalar.z == 0.0f;
+  ImGui::Text(
+    "Solve time: %.3f ms (%.3f us per leg)",
+    mech.legs_time,
+    mech.legs.size() > 0 ? 1000.0f * mech.legs_time / mech.legs.size() : 0.0f);
+  static bool scalar_solver = false;
+  ImGui::Checkbox("Scalar Solver", &scalar_solver);
+  mech.legs_kernel = scalar_solver ? NoiseKernel::Scalar : noise_kernel();
+  ImGui::SameLine();
+  ImGui::Text("Kernel: %s", noise_kernel_name(mech.legs_kernel));
+
+  static std::vector<LegSolverBenchmark> solver_results;
+  if (ImGui::Button("Benchmark Solver"))
+  {
+    solver_results.clear();
+    for (const size_t legs_count : { 4, 64, 1024, 16384 })
+      for (const auto &result : leg_solver_benchmark(legs_count, mech.ik_iterations))
+        solver_results.push_back(result);
+  }
+  for (const auto &result : solver_results)
+    ImGui::Text(
+      "%-8s %5lu legs %8.3f us/leg  max error %g (%lu over tolerance)",
+      noise_kernel_name(result.kernel),
+      result.legs_count,
+      result.us_per_leg,
+      result.max_error,
+      result.mismatches);
+  ImGui::Separator();
+
+  auto rotation_scalar_checkbox = [](LegChains::Part &part, const size_t leg) {
+    bool lock_x = part.sx[leg] == 0.0f;
+    bool lock_y = part.sy[leg] == 0.0f;
+    bool lock_z = part.sz[leg] == 0.0f;
     ImGui::Checkbox("X", &lock_x);
     ImGui::SameLine();
     ImGui::Checkbox("Y", &lock_y);
     ImGui::SameLine();
     ImGui::Checkbox("Z", &lock_z);
-    leg.rotation_scalar.x = lock_x ? 0.0f : 1.0f;
-    leg.rotation_scalar.y = lock_y ? 0.0f : 1.0f;
-    leg.rotation_scalar.z = lock_z ? 0.0f : 1.0f;
+    part.sx[leg] = lock_x ? 0.0f : 1.0f;
+    part.sy[leg] = lock_y ? 0.0f : 1.0f;
+    part.sz[leg] = lock_z ? 0.0f : 1.0f;
   };
   ImGui::PushID("LegsLockAxis");
   ImGui::Text("Lock Rotation Direction:");
@@ -221,50 +267,47 @@ void Debug::mech_properties_legs(Mech &mech)
 
   if (individually)
   {
-    for (size_t i = 0; i < mech.legs_e.size(); ++i)
+    for (size_t i = 0; i < mech.legs.size(); ++i)
     {
       ImGui::Text("Leg %lu", i);
       ImGui::PushID(i * 1200 + 0);
       ImGui::Text("Segment 1/3");
       ImGui::SameLine();
-      rotation_scalar_checkbox(*mech.legs_b[i]);
+      rotation_scalar_checkbox(mech.legs.parts[0], i);
       ImGui::PopID();
       ImGui::PushID(i * 1200 + 1);
       ImGui::Text("Segment 2/3");
       ImGui::SameLine();
-      rotation_scalar_checkbox(*mech.legs_m[i]);
+      rotation_scalar_checkbox(mech.legs.parts[1], i);
       ImGui::PopID();
       ImGui::PushID(i * 1200 + 2);
       ImGui::Text("Segment 3/3");
       ImGui::SameLine();
-      rotation_scalar_checkbox(*mech.legs_e[i]);
+      rotation_scalar_checkbox(mech.legs.parts[2], i);
       ImGui::PopID();
     }
   }
-  else
+  else if (mech.legs.size() > 0)
   {
     ImGui::PushID(1300 + 0);
     ImGui::Text("Segment 1/3");
     ImGui::SameLine();
-    rotation_scalar_checkbox(*mech.legs_b[0]);
+    rotation_scalar_checkbox(mech.legs.parts[0], 0);
     ImGui::PopID();
     ImGui::PushID(1300 + 1);
     ImGui::Text("Segment 2/3");
     ImGui::SameLine();
-    rotation_scalar_checkbox(*mech.legs_m[0]);
+    rotation_scalar_checkbox(mech.legs.parts[1], 0);
     ImGui::PopID();
     ImGui::PushID(1300 + 2);
     ImGui::Text("Segment 3/3");
     ImGui::SameLine();
-    rotation_scalar_checkbox(*mech.legs_e[0]);
+    rotation_scalar_checkbox(mech.legs.parts[2], 0);
     ImGui::PopID();
 
-    for (size_t i = 1; i < mech.legs_e.size(); ++i)
-    {
-      mech.legs_b[i]->rotation_scalar = mech.legs_b[0]->rotation_scalar;
-      mech.legs_m[i]->rotation_scalar = mech.legs_m[0]->rotation_scalar;
-      mech.legs_e[i]->rotation_scalar = mech.legs_e[0]->rotation_scalar;
-    }
+    for (auto &part : mech.legs.parts)
+      for (size_t i = 1; i < mech.legs.size(); ++i)
+        part.set_rotation_scalar(i, part.get_rotation_scalar(0));
   }
   ImGui::PopID();
   ImGui::Separator();
@@ -273,6 +316,51 @@ void Debug::mech_properties_legs(Mech &mech)
 void Debug::ground_properties(Ground &ground)
 {
   ImGui::Text("UNIT = %10.5f", ground.UNIT);
+  ImGui::Text("Chunks loaded: %lu, generating: %lu", ground.chunks.size(), ground.pending_chunks.size());
+  ImGui::Text("Chunk radius: %ld, cache size: %lu", ground.chunk_radius, ground.chunk_cache_size);
+  ImGui::Text(
+    "Chunks read from disk: %lu, generated: %lu", ground.chunks_read.load(), ground.chunks_generated.load());
+  ImGui::Checkbox("Frustum Culling", &ground.frustum_culling);
+  ImGui::SameLine();
+  ImGui::Checkbox("Level of Detail", &ground.lod_enabled);
+  ImGui::DragFloat("LOD Distance", &ground.lod_distance, 1.0, 10.0f, 1000.0f);
+  ImGui::Text("Chunks drawn: %lu / %lu", ground.drawn_chunks, ground.chunks.size());
+  ImGui::Text(
+    "Triangles: %lu / %lu (%.1f%%)",
+    ground.drawn_triangles,
+    ground.full_detail_triangles,
+    ground.full_detail_triangles > 0 ? 100.0 * ground.drawn_triangles / ground.full_detail_triangles : 0.0);
+  ImGui::Checkbox("Occlusion Culling", &ground.occlusion_culling);
+  ImGui::Text(
+    "Occluded chunks: %lu, props: %lu / %lu, occluder triangles: %lu (%.2f ms)",
+    ground.occluded_chunks,
+    ground.occluded_queries,
+    ground.occlusion_queries,
+    ground.occlusion.get_triangles_count(),
+    ground.occlusion_time);
+  ImGui::Checkbox("Geometry Clipmap", &ground.clipmap_enabled);
+  if (ground.clipmap_enabled)
+    ImGui::Text(
+      "Clipmap levels: %lu, triangles: %lu, texels streamed: %lu, extent: %.0f",
+      ground.clipmap->get_levels_count(),
+      ground.clipmap->get_triangles_count(),
+      ground.clipmap->get_texels_updated(),
+      ground.clipmap->get_extent());
+  const auto tiles = ground.terrain->get_tile_stats();
+  const size_t queries = tiles.hits + tiles.misses;
+  ImGui::Text(
+    "Height tiles: %lu / %lu, hit rate: %.1f%% of %lu, evicted: %lu",
+    tiles.tiles,
+    tiles.capacity,
+    queries > 0 ? 100.0 * tiles.hits / queries : 0.0,
+    queries,
+    tiles.evictions);
+  ImGui::SameLine();
+  if (ImGui::Button("Reset##HeightTiles"))
+    ground.terrain->reset_tile_stats();
+  ImGui::Text("Noise layers:");
+  for (const auto &layer : ground.terrain->get_noise().get_layers())
+    ImGui::BulletText("%s", layer.describe().c_str());
   ImGui::Separator();
   ImGui::DragFloat("Stones Factor", &ground.stones_factor, 0.1, -100.0f, 100.0f);
   ImGui::DragFloat("Grass Factor", &ground.grass_factor, 0.1, -100.0f, 100.0f);
@@ -281,4 +369,85 @@ void Debug::ground_properties(Ground &ground)
   
   ImGui::DragFloat("Stones Blur", &ground.stones_blur, 0.1, -100.0f, 100.0f);
   ImGui::DragFloat("Grass  Blur", &ground.grass_blur, 0.1, -100.0f, 100.0f);
+
+  ImGui::Separator();
+
+  static std::vector<NoiseBenchmark> noise_results;
+  ImGui::Text("Noise kernel: %s", noise_kernel_name(noise_kernel()));
+  if (ImGui::Button("Benchmark Noise"))
+    noise_results = noise_benchmark(1 << 20);
+  for (const auto &result : noise_results)
+    ImGui::Text(
+      "%-8s %8.3f ns/point  max error %g",
+      noise_kernel_name(result.kernel),
+      result.ns_per_point,
+      result.max_error);
+}
+
+void Debug::visibility_properties(World &world)
+{
+  const TerrainVisibility &visibility = *world.visibility;
+  ImGui::Text("Cells: %lu, levels: %lu", visibility.get_cells_count(), visibility.get_levels_count());
+
+  static float eye_height = 10.0f;
+  static float target_height = 2.0f;
+  static float max_distance = 300.0f;
+  ImGui::DragFloat("Eye Height", &eye_height, 0.1f, 0.0f, 100.0f);
+  ImGui::DragFloat("Target Height", &target_height, 0.1f, 0.0f, 100.0f);
+  ImGui::DragFloat("Max Distance", &max_distance, 1.0f, 10.0f, 2000.0f);
+
+  static size_t viewshed_cells = 0;
+  static double viewshed_time = 0.0;
+  if (ImGui::Button("Viewshed from the mech"))
+  {
+    glm::vec3 eye = world.mech->get_position();
+    eye.y = world.terrain->get_y(eye.x, eye.z) + eye_height;
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto cells =
+      visibility.get_viewshed(eye, *world.grid_map, { world.X_SPACING, world.Z_SPACING }, max_distance, target_height);
+    viewshed_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    viewshed_cells = cells.size();
+
+    Debug::clear_cubes("Viewshed");
+    for (const auto &[x, z] : cells)
+    {
+      const glm::vec3 p { x * world.X_SPACING, 0.0f, z * world.Z_SPACING };
+      Debug::add_cube("Viewshed", { p.x, world.terrain->get_y(p.x, p.z) + target_height, p.z });
+    }
+    Debug::enable("Viewshed");
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Clear##Viewshed"))
+    Debug::clear_cubes("Viewshed");
+  ImGui::Text("Visible cells: %lu (%.2f ms)", viewshed_cells, viewshed_time);
+
+  // random segments of up to the max distance starting around the mech
+  static double query_time = 0.0;
+  static size_t visible_queries = 0;
+  static constexpr size_t QUERIES = 4096;
+  if (ImGui::Button("Benchmark Line of Sight"))
+  {
+    std::mt19937 generator(QUERIES);
+    std::uniform_real_distribution<float> random(-1.0f, 1.0f);
+    std::vector<glm::vec3> from(QUERIES), to(QUERIES);
+    const glm::vec3 center = world.mech->get_position();
+    for (size_t k = 0; k < QUERIES; k++)
+    {
+      const float ax = center.x + random(generator) * max_distance;
+      const float az = center.z + random(generator) * max_distance;
+      const float bx = center.x + random(generator) * max_distance;
+      const float bz = center.z + random(generator) * max_distance;
+      from[k] = { ax, world.terrain->get_y(ax, az) + eye_height, az };
+      to[k] = { bx, world.terrain->get_y(bx, bz) + target_height, bz };
+    }
+
+    std::vector<uint8_t> visible(QUERIES);
+    const auto start = std::chrono::steady_clock::now();
+    visibility.line_of_sight_batch(from, to, visible);
+    query_time = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    visible_queries = std::count(visible.begin(), visible.end(), 1);
+  }
+  ImGui::Text(
+    "%lu queries: %.1f us, %.3f us/query, visible: %lu", QUERIES, query_time, query_time / QUERIES, visible_queries);
 }
@@ -11,6 +11,7 @@
 
 class Mech;
 class Ground;
+struct World;
 struct Debug;
 
 #ifdef DEBUG
@@ -177,6 +178,7 @@ struct Debug
   static void mech_properties_legs(Mech &);
 
   static void ground_properties(Ground &);
+  static void visibility_properties(World &);
 private:
   static GLuint buffer;
   static std::shared_ptr<ZD::Model> cube;
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+
+#include "ZD/View.hpp"
+
+// planes of the view volume, normals point inside
+struct Frustum
+{
+  Frustum(const ZD::View &view)
+  {
+    const glm::mat4 m = view.get_projection_matrix() * view.get_view_matrix();
+    const auto row = [&m](const int r) { return glm::vec4 { m[0][r], m[1][r], m[2][r], m[3][r] }; };
+
+    planes = { row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(3) + row(2), row(3) - row(2) };
+    for (auto &plane : planes)
+      plane /= glm::length(glm::vec3 { plane.x, plane.y, plane.z });
+  }
+
+  // false only when the box is certainly outside, boxes close to the corners may pass
+  bool contains_box(const glm::vec3 &min, const glm::vec3 &max) const
+  {
+    for (const auto &plane : planes)
+    {
+      // the corner furthest along the plane normal
+      const glm::vec3 p { plane.x > 0.0f ? max.x : min.x,
+                          plane.y > 0.0f ? max.y : min.y,
+                          plane.z > 0.0f ? max.z : min.z };
+      if (plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w < 0.0f)
+        return false;
+    }
+    return true;
+  }
+
+  std::array<glm::vec4, 6> planes;
+};
@@ -1,58 +1,151 @@
 #include "gridmap.hpp"
-#include "world.hpp"
 
+#include <algorithm>
+#include <set>
 #include <utility>
 
-std::vector<std::pair<int, int>> GridMap::get_path(int start_x, int start_y, int end_x, int end_y) const
+void GridMap::add(int x, int y, float slope, double prop_cost)
+{
+  {
+    const std::unique_lock lock { nodes_mutex };
+    Node &node = nodes.insert({ std::pair { x, y }, Node { x, y } }).first->second;
+    node.slope = slope;
+    node.prop_cost = prop_cost;
+    nodes_version++;
+  }
+  const std::lock_guard lock { cost_layers_mutex };
+  cost_layers.clear();
+}
+
+void GridMap::remove(int begin_x, int end_x, int begin_y, int end_y)
+{
+  {
+    const std::unique_lock lock { nodes_mutex };
+    for (int x = begin_x; x < end_x; x++)
+      nodes.erase(nodes.lower_bound({ x, begin_y }), nodes.lower_bound({ x, end_y }));
+    nodes_version++;
+  }
+  const std::lock_guard lock { cost_layers_mutex };
+  cost_layers.clear();
+}
+
+std::vector<std::pair<int, int>> GridMap::get_node_keys() const
+{
+  const std::shared_lock lock { nodes_mutex };
+  std::vector<std::pair<int, int>> keys;
+  keys.reserve(nodes.size());
+  for (const auto &[key, node] : nodes)
+    keys.push_back(key);
+  return keys;
+}
+
+std::shared_ptr<const GridMap::CostLayer> GridMap::get_cost_layer(const CostProfile &profile) const
+{
+  {
+    const std::lock_guard lock { cost_layers_mutex };
+    const auto layer_it = std::find_if(
+      cost_layers.begin(), cost_layers.end(), [&](const auto &cached) { return cached.first == profile; });
+    if (layer_it != cost_layers.end())
+    {
+      std::rotate(cost_layers.begin(), layer_it, layer_it + 1);
+      return cost_layers.front().second;
+    }
+  }
+
+  // built without the cache lock, a layer built twice by racing threads is only wasted work
+  size_t version;
+  std::shared_ptr<const CostLayer> layer;
+  {
+    const std::shared_lock lock { nodes_mutex };
+    version = nodes_version;
+    layer = std::make_shared<const CostLayer>(build_cost_layer(profile));
+  }
+
+  // nodes added in the meantime have cleared the cache already, the layer would be stale there
+  const std::shared_lock nodes_lock { nodes_mutex };
+  const std::lock_guard lock { cost_layers_mutex };
+  if (version != nodes_version)
+    return layer;
+  cost_layers.insert(cost_layers.begin(), { profile, layer });
+  if (cost_layers.size() > COST_LAYERS_CAPACITY)
+    cost_layers.pop_back();
+  return layer;
+}
+
+// under the shared lock of the nodes
+GridMap::CostLayer GridMap::build_cost_layer(const CostProfile &profile) const
+{
+  CostLayer layer;
+  for (const auto &[key, node] : nodes)
+    layer.insert({ key, node.calculate_cost(profile) });
+
+  // remove impassable nodes together with their surroundings
+  const int REMOVE_R = 1;
+  for (const auto &[key, node] : nodes)
+  {
+    if (node.calculate_cost(profile) > 0.99)
+    {
+      for (int iy = -REMOVE_R; iy <= REMOVE_R; ++iy)
+        for (int ix = -REMOVE_R; ix <= REMOVE_R; ++ix)
+          layer.erase({ key.first + ix, key.second + iy });
+    }
+  }
+
+  return layer;
+}
+
+std::vector<std::pair<int, int>> GridMap::get_path(
+  int start_x, int start_y, int end_x, int end_y, const CostProfile &profile) const
 {
   const auto h_score = [&](int x, int y) -> double { return sqrt(pow(end_x - x, 2) + pow(end_y - y, 2)); };
 
+  const std::shared_ptr<const CostLayer> layer_ptr = get_cost_layer(profile);
+  const CostLayer &layer = *layer_ptr;
+
   std::vector<std::pair<int, int>> path; // result
-  std::map<std::pair<int, int>, const GridMap::Node *> open_nodes; // node candidates, neighbours of visited
+  std::set<std::pair<int, int>> open_nodes; // node candidates, neighbours of visited
   std::map<std::pair<int, int>, double> scores; // best scores from start to node
   std::map<std::pair<int, int>, double> f_scores; // prediction of best path from node to end
   std::map<std::pair<int, int>, std::pair<int, int>> next_previous; // best links between the next and the previous
 
   // search if start and end node does even exist
-  const auto idx_node_it = nodes.find({ start_x, start_y });
-  if (!nodes.contains({ end_x, end_y }) || idx_node_it == nodes.end())
+  if (!layer.contains({ end_x, end_y }) || !layer.contains({ start_x, start_y }))
     return path;
 
   // initial values for first (Start) node
   scores.insert({ { start_x, start_y }, 0.0 });
   f_scores.insert({ { start_x, start_y }, h_score(start_x, start_y) });
-  const GridMap::Node *n = &idx_node_it->second;
-  open_nodes.insert({ { start_x, start_y }, n });
+  open_nodes.insert({ start_x, start_y });
 
   while (!open_nodes.empty())
   {
-    const Node *current = open_nodes.begin()->second;
+    std::pair<int, int> current = *open_nodes.begin();
     // search for best predicted not visited node
-    for (const auto &idx_node : open_nodes)
+    for (const auto &idx : open_nodes)
     {
-      if (f_scores.at(idx_node.first) < f_scores.at({ current->x, current->y }))
-        current = idx_node.second;
+      if (f_scores.at(idx) < f_scores.at(current))
+        current = idx;
     }
 
-    if (current->x == end_x && current->y == end_y)
+    if (current.first == end_x && current.second == end_y)
       break;
 
-    open_nodes.erase({ current->x, current->y });
+    open_nodes.erase(current);
 
     // check neighbours
-    const double score_to_current = scores.find({ current->x, current->y })->second;
+    const double score_to_current = scores.find(current)->second;
     for (int iy = -1; iy <= 1; ++iy)
       for (int ix = -1; ix <= 1; ++ix)
       {
         if (ix == 0 && iy == 0)
           continue;
 
-        const std::pair<int, int> neighbour_idx { current->x + ix, current->y + iy };
-        const auto neighbour = nodes.find(neighbour_idx);
-        if (neighbour != nodes.end())
+        const std::pair<int, int> neighbour_idx { current.first + ix, current.second + iy };
+        const auto neighbour = layer.find(neighbour_idx);
+        if (neighbour != layer.end())
         {
           // score to neighbour from the start
-          const double sc = score_to_current + neighbour->second.cost + 1.0;
+          const double sc = score_to_current + neighbour->second + 1.0;
           if (scores.find(neighbour_idx) == scores.end() || scores.at(neighbour_idx) > sc)
           {
             scores.insert({ neighbour_idx, sc });
@@ -61,8 +154,8 @@ std::vector<std::pair<int, int>> GridMap::get_path(int start_x, int start_y, int
             const double f_sc = sc + h_score(neighbour_idx.first, neighbour_idx.second);
             f_scores.insert({ neighbour_idx, f_sc });
 
-            next_previous.insert({ neighbour_idx, { current->x, current->y } });
-            open_nodes.insert({ neighbour_idx, &neighbour->second });
+            next_previous.insert({ neighbour_idx, current });
+            open_nodes.insert(neighbour_idx);
           }
         }
       }
@@ -79,24 +172,3 @@ std::vector<std::pair<int, int>> GridMap::get_path(int start_x, int start_y, int
 
   return path;
 }
-
-void GridMap::clear_bad_nodes(const World &world)
-{
-  const int REMOVE_R = 1;
-
-  for (ssize_t i = world.MIN_X; i < world.MAX_X; i++)
-    for (ssize_t j = world.MIN_Z; j < world.MAX_Z; j++)
-    {
-      const std::pair<int, int> key { i, j };
-
-      if (!nodes.contains(key))
-        continue;
-
-      if (nodes.at(key).cost > 0.99)
-      {
-        for (int iy = -REMOVE_R; iy <= REMOVE_R; ++iy)
-          for (int ix = -REMOVE_R; ix <= REMOVE_R; ++ix)
-            nodes.erase({ i + ix, j + iy });
-      }
-    }
-}
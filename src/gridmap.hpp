@@ -1,7 +1,10 @@
 #pragma once
 #include <map>
 #include <memory>
+#include <mutex>
 #include <random>
+#include <shared_mutex>
+#include <vector>
 
 #include "prop.hpp"
 #include "ZD/3rd/glm/glm.hpp"
@@ -11,22 +14,60 @@ struct World;
 class GridMap
 {
 public:
+  // traversal tolerance of a single agent type
+  struct CostProfile
+  {
+    float normal_factor { 3.0f };
+
+    auto operator<=>(const CostProfile &) const = default;
+  };
+
   struct Node
   {
     const int x;
     const int y;
-    double cost { 0.0 };
+    float slope { 0.0f }; // 1 - |n . up| of the terrain at the node
+    double prop_cost { 0.0 }; // cost of the prop occupying the node
+
+    static float calculate_slope(const glm::vec3 normal)
+    {
+      return 1.0f - fabs(glm::dot(normal, glm::vec3 { 0.0, 1.0, 0.0 }));
+    }
 
-    static double calculate_cost(const glm::vec3 normal, float normal_factor, std::shared_ptr<Prop> prop_occupying)
+    double calculate_cost(const CostProfile &profile) const
     {
-      const double occupied_factor = prop_occupying ? prop_occupying->cost : 0.0;
-      const double normal_cost = 1.0 - fabs(glm::dot(normal, glm::vec3 { 0.0, 1.0, 0.0 }));
-      return std::min(normal_cost * normal_factor + occupied_factor, 1.0);
+      return std::min(static_cast<double>(slope) * profile.normal_factor + prop_cost, 1.0);
     }
   };
+
+  // node costs derived for a single profile, nodes impassable for the profile are left out
+  using CostLayer = std::map<std::pair<int, int>, double>;
+
+  // adds the node or replaces the values of the one already at x, y
+  void add(int x, int y, float slope, double prop_cost);
+  // removes the nodes with x in [begin_x, end_x) and y in [begin_y, end_y)
+  void remove(int begin_x, int end_x, int begin_y, int end_y);
+  // positions of all the nodes
+  std::vector<std::pair<int, int>> get_node_keys() const;
+
+  // the layer of the profile, built on first use and cached for the few last used profiles,
+  // a returned layer stays valid after nodes are added or it is dropped from the cache
+  std::shared_ptr<const CostLayer> get_cost_layer(const CostProfile &profile) const;
+  std::vector<std::pair<int, int> > get_path(
+    int start_x, int start_y, int end_x, int end_y, const CostProfile &profile) const;
+
+private:
+  static constexpr size_t COST_LAYERS_CAPACITY { 4 };
+
+  CostLayer build_cost_layer(const CostProfile &profile) const;
+
+  // nodes are changed under the exclusive lock and read under the shared one, so paths may be searched
+  // from any thread while the chunks add their nodes
+  mutable std::shared_mutex nodes_mutex;
   std::map<std::pair<int, int>, Node> nodes;
+  size_t nodes_version { 0 }; // layers built from an older version of the nodes are not cached
 
-  Node &add(int x, int y) { return nodes.insert({ std::pair { x, y }, Node { x, y } }).first->second; }
-  std::vector<std::pair<int, int> > get_path(int start_x, int start_y, int end_x, int end_y) const;
-  void clear_bad_nodes(const World &world);
+  // most recently used first
+  mutable std::mutex cost_layers_mutex;
+  mutable std::vector<std::pair<CostProfile, std::shared_ptr<const CostLayer>>> cost_layers;
 };
@@ -2,14 +2,118 @@
 
 #include "ZD/ShaderLoader.hpp"
 
-#define STB_PERLIN_IMPLEMENTATION
-#include "3rd/stb_perlin.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <thread>
 
+#include "cache.hpp"
+#include "clipmap.hpp"
 #include "debug.hpp"
 #include "config.hpp"
+#include "frustum.hpp"
 
-Ground::Ground(const ConfigKeysValues &world_config)
+static inline ssize_t floor_div(const ssize_t a, const ssize_t b)
+{
+  return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+GroundIndices::~GroundIndices()
+{
+  glDeleteBuffers(1, &index_buffer);
+}
+
+void GroundIndices::upload(const std::vector<GLuint> &surface, const std::vector<GLuint> &skirts)
+{
+  if (index_buffer == 0)
+    glGenBuffers(1, &index_buffer);
+
+  std::vector<GLuint> indices;
+  indices.reserve(surface.size() + skirts.size());
+  indices.insert(indices.end(), surface.begin(), surface.end());
+  indices.insert(indices.end(), skirts.begin(), skirts.end());
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+  surface_count = surface.size();
+  indices_count = indices.size();
+}
+
+GroundMesh::~GroundMesh()
+{
+  glDeleteBuffers(1, &vertex_buffer);
+}
+
+void GroundMesh::upload(const std::vector<GroundVertex> &vertices)
+{
+  if (vertex_buffer == 0)
+    glGenBuffers(1, &vertex_buffer);
+
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GroundVertex), vertices.data(), GL_STATIC_DRAW);
+  vertices_count = vertices.size();
+}
+
+void GroundMesh::draw(ZD::ShaderProgram &shader, const GroundIndices &indices, const bool with_skirts) const
+{
+  if (vertices_count == 0 || indices.get_count(with_skirts) == 0)
+    return;
+
+  const auto grid_attribute = shader.get_attribute("vertex_grid");
+  const auto height_attribute = shader.get_attribute("vertex_height");
+
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+  glEnableVertexAttribArray(grid_attribute->index);
+  glVertexAttribPointer(
+    grid_attribute->index, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(GroundVertex), (void *)offsetof(GroundVertex, x));
+  glEnableVertexAttribArray(height_attribute->index);
+  glVertexAttribPointer(
+    height_attribute->index, 2, GL_SHORT, GL_FALSE, sizeof(GroundVertex), (void *)offsetof(GroundVertex, y));
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.get_buffer());
+  glDrawElements(GL_TRIANGLES, indices.get_count(with_skirts), GL_UNSIGNED_INT, (void *)0);
+
+  glDisableVertexAttribArray(grid_attribute->index);
+  glDisableVertexAttribArray(height_attribute->index);
+}
+
+GroundSurface::~GroundSurface()
+{
+  glDeleteTextures(1, &texture);
+}
+
+void GroundSurface::upload(const size_t size, const std::vector<uint8_t> &texels)
+{
+  assert(texels.size() == size * size * 4);
+  if (texture == 0)
+  {
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    return;
+  }
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+}
+
+void GroundSurface::bind(const GLuint unit) const
+{
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+Ground::Ground(const ConfigKeysValues &world_config, std::shared_ptr<const TerrainField> terrain)
 : ZD::Entity({ 0.0, 0.0, 0.0 }, {}, { 1.0, 1.0, 1.0 })
+, UNIT { terrain->UNIT }
+, terrain { std::move(terrain) }
 {
   shader = ZD::ShaderLoader()
              .add(ZD::File("shaders/ground.vertex.glsl"), GL_VERTEX_SHADER)
@@ -21,53 +125,68 @@ Ground::Ground(const ConfigKeysValues &world_config)
   stones_blur = world_config.get_float("StonesBlur", stones_blur);
   grass_blur = world_config.get_float("GrassBlur", grass_blur);
 
-  auto model = ZD::Model::create();
-
-  for (ssize_t i = 0; i < world_config.get_int("GroundW", 200); i++)
-    for (ssize_t j = 0; j < world_config.get_int("GroundH", 200); j++)
-    {
-      const float x = ((float)(i)-100.0f) * UNIT;
-      const float z = ((float)(j)-100.0f) * UNIT;
-
-      const float y0 = get_y(x, z);
-      const float y1 = get_y(x + UNIT, z);
-      const float y2 = get_y(x + UNIT, z + UNIT);
-      const float y3 = get_y(x, z + UNIT);
-
-      glm::vec3 n = get_n(x, z);
-      Debug::add_line("Ground Normals", glm::vec3 { x, y0, z }, glm::vec3 { x, y0, z } + n * 10.0f);
+  chunk_radius = std::max(1, world_config.get_int("ChunkRadius", chunk_radius));
+  const size_t chunks_in_radius = (chunk_radius * 2 + 1) * (chunk_radius * 2 + 1);
+  chunk_cache_size = std::max<size_t>(chunks_in_radius, world_config.get_int("ChunkCacheSize", chunks_in_radius * 2));
 
-      n = get_n(x + UNIT, z + UNIT);
-      model->add_vertex(x + UNIT, y2, z + UNIT);
-      model->add_uv(1.0, 1.0);
-      model->add_normal(n.x, n.y, n.z);
+  lod_distance = std::max(1.0f, world_config.get_float("LodDistance", lod_distance));
 
-      model->add_vertex(x + UNIT, y1, z);
-      model->add_uv(1.0, 0.0);
-      n = get_n(x + UNIT, z);
-      model->add_normal(n.x, n.y, n.z);
+  clipmap_shader = ZD::ShaderLoader()
+                     .add(ZD::File("shaders/clipmap.vertex.glsl"), GL_VERTEX_SHADER)
+                     .add(ZD::File("shaders/clipmap.fragment.glsl"), GL_FRAGMENT_SHADER)
+                     .compile();
+  clipmap = std::make_unique<GroundClipmap>(
+    this->terrain, std::max(1, world_config.get_int("ClipmapLevels", 8)),
+    std::max(8, world_config.get_int("ClipmapSize", 64)));
+  clipmap_enabled = world_config.get_string("GroundRenderer", "Chunks") == "Clipmap";
 
-      model->add_vertex(x, y0, z);
-      model->add_uv(0.0, 0.0);
-      n = get_n(x, z);
-      model->add_normal(n.x, n.y, n.z);
+  // every chunk has the same topology, quads are emitted in column stripes narrow enough
+  // for the previous row of vertices to still be in the post-transform cache
+  static constexpr ssize_t STRIPE_W = 16;
+  static constexpr ssize_t CORNERS = GroundChunk::CORNERS;
+  static constexpr ssize_t CELLS = GroundChunk::CELLS;
+  for (size_t level = 0; level < GroundChunk::LEVELS; level++)
+  {
+    const ssize_t step = 1 << level;
+    std::vector<GLuint> surface;
+    surface.reserve((CELLS / step) * (CELLS / step) * 6);
+    for (ssize_t stripe = 0; stripe < CELLS; stripe += STRIPE_W * step)
+      for (ssize_t j = 0; j < CELLS; j += step)
+        for (ssize_t i = stripe; i < std::min(stripe + STRIPE_W * step, CELLS); i += step)
+        {
+          const GLuint v00 = j * CORNERS + i;
+          const GLuint v10 = v00 + step;
+          const GLuint v01 = v00 + step * CORNERS;
+          const GLuint v11 = v01 + step;
+          surface.insert(surface.end(), { v11, v10, v00, v00, v01, v11 });
+        }
 
-      model->add_vertex(x, y0, z);
-      model->add_uv(0.0, 0.0);
-      n = get_n(x, z);
-      model->add_normal(n.x, n.y, n.z);
+    // skirt vertices hang below the borders in the order of j = 0, j = CELLS, i = 0, i = CELLS
+    std::vector<GLuint> skirts;
+    skirts.reserve((CELLS / step) * 4 * 12);
+    for (ssize_t side = 0; side < 4; side++)
+      for (ssize_t k = 0; k < CELLS; k += step)
+      {
+        const auto border = [&](const ssize_t c) -> GLuint {
+          switch (side)
+          {
+            case 0: return c;
+            case 1: return CELLS * CORNERS + c;
+            case 2: return c * CORNERS;
+            default: return c * CORNERS + CELLS;
+          }
+        };
+        const GLuint a = border(k);
+        const GLuint b = border(k + step);
+        const GLuint skirt = CORNERS * CORNERS + side * CORNERS;
+        const GLuint sa = skirt + k;
+        const GLuint sb = skirt + k + step;
+        // both windings, the crack can be seen from either side
+        skirts.insert(skirts.end(), { a, sa, sb, sb, b, a, a, b, sb, sb, sa, a });
+      }
 
-      model->add_vertex(x, y3, z + UNIT);
-      model->add_uv(0.0, 1.0);
-      n = get_n(x, z + UNIT);
-      model->add_normal(n.x, n.y, n.z);
-
-      model->add_vertex(x + UNIT, y2, z + UNIT);
-      model->add_uv(1.0, 1.0);
-      n = get_n(x + UNIT, z + UNIT);
-      model->add_normal(n.x, n.y, n.z);
-    }
-  model->regenerate_buffers();
+    level_indices[level].upload(surface, skirts);
+  }
 
   const ZD::TextureParameters texture_params { .wrap = ZD::TextureWrap { UNIT / 10.0f, UNIT / 10.0f },
                                                .generate_mipmap = true,
@@ -84,64 +203,731 @@ Ground::Ground(const ConfigKeysValues &world_config)
   texture = ZD::Texture::load(ZD::Image::load("textures/ground106_diffuse.tga"), texture_params);
   texture->set_name("sampler3");
   add_texture(texture);
+}
+
+Ground::~Ground()
+{
+  // the loads still running read the cache settings and the counters declared after pending_chunks,
+  // they have to finish before any member is destroyed
+  for (auto &[key, chunk] : pending_chunks)
+    chunk.wait();
+  pending_chunks.clear();
+}
+
+static constexpr uint32_t GROUND_CHUNK_MAGIC { cache_magic("GRND") };
+
+static std::filesystem::path chunk_file_name(const std::filesystem::path &directory, const ssize_t x, const ssize_t z)
+{
+  return directory / ("ground_" + std::to_string(x) + "_" + std::to_string(z) + ".bin");
+}
+
+void Ground::set_cache(const std::filesystem::path &directory, const uint64_t key)
+{
+  cache_directory = directory;
+  cache_key = key;
+
+  std::error_code error;
+  if (!cache_directory.empty() && !std::filesystem::create_directories(cache_directory, error) && error)
+  {
+    fprintf(stderr, "Cannot create cache directory %s: %s\n", cache_directory.c_str(), error.message().data());
+    cache_directory.clear();
+  }
+}
+
+std::unique_ptr<GroundChunk> Ground::load_chunk(const ssize_t x, const ssize_t z) const
+{
+  if (!cache_directory.empty())
+  {
+    if (auto chunk = read_chunk(x, z))
+    {
+      chunks_read++;
+      return chunk;
+    }
+  }
+
+  auto chunk = generate_chunk(x, z);
+  chunks_generated++;
+  if (!cache_directory.empty())
+    save_chunk(*chunk);
+  return chunk;
+}
+
+std::unique_ptr<GroundChunk> Ground::read_chunk(const ssize_t x, const ssize_t z) const
+{
+  auto reader = CacheReader::open(chunk_file_name(cache_directory, x, z), GROUND_CHUNK_MAGIC, cache_key);
+  if (!reader)
+    return nullptr;
+
+  static constexpr size_t CORNERS = GroundChunk::CORNERS;
+  static constexpr size_t CELLS = GroundChunk::CELLS;
+  auto chunk = std::make_unique<GroundChunk>(x, z);
+  bool valid = reader->read(chunk->min_y) && reader->read(chunk->max_y) && reader->read(chunk->skirt_depth) &&
+               reader->read(chunk->height_origin) && reader->read(chunk->height_scale) &&
+               reader->read(chunk->heights, CORNERS * CORNERS) && reader->read(chunk->vertex_normals, CORNERS * CORNERS) &&
+               reader->read(chunk->face_normals, CELLS * CELLS * 2) &&
+               reader->read(chunk->vertices, CORNERS * CORNERS + GroundChunk::SKIRT_VERTICES);
+  for (size_t level = 0; level < GroundChunk::LEVELS && valid; level++)
+    valid = reader->read(chunk->height_bounds[level], (CELLS >> level) * (CELLS >> level));
+
+  if (!valid || !reader->at_end())
+    return nullptr;
+  return chunk;
+}
+
+void Ground::save_chunk(const GroundChunk &chunk) const
+{
+  CacheWriter writer(GROUND_CHUNK_MAGIC, cache_key);
+  writer.write(chunk.min_y);
+  writer.write(chunk.max_y);
+  writer.write(chunk.skirt_depth);
+  writer.write(chunk.height_origin);
+  writer.write(chunk.height_scale);
+  writer.write(chunk.heights);
+  writer.write(chunk.vertex_normals);
+  writer.write(chunk.face_normals);
+  writer.write(chunk.vertices);
+  for (const auto &bounds : chunk.height_bounds)
+    writer.write(bounds);
+
+  if (!writer.save(chunk_file_name(cache_directory, chunk.x, chunk.z)))
+    fprintf(stderr, "Cannot save ground chunk %ld,%ld to the cache\n", chunk.x, chunk.z);
+}
+
+// maps the unit sphere onto a square, the lower hemisphere folded over the diagonals
+static glm::vec2 encode_octahedral(const glm::vec3 &n)
+{
+  const float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+  glm::vec2 p { n.x / sum, n.z / sum };
+  if (n.y < 0.0f)
+  {
+    const glm::vec2 folded { (1.0f - std::fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+                             (1.0f - std::fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f) };
+    p = folded;
+  }
+  return p;
+}
+
+std::unique_ptr<GroundChunk> Ground::generate_chunk(const ssize_t x, const ssize_t z) const
+{
+  auto chunk = std::make_unique<GroundChunk>(x, z);
+
+  static constexpr ssize_t CORNERS = GroundChunk::CORNERS;
+  static constexpr ssize_t CELLS = GroundChunk::CELLS;
+  const ssize_t min_i = x * CELLS;
+  const ssize_t min_j = z * CELLS;
+
+  // heights and normals of the corners come from the same noise evaluation
+  chunk->heights.resize(CORNERS * CORNERS);
+  chunk->vertex_normals.resize(CORNERS * CORNERS);
+  std::array<float, CORNERS> row_x, row_z;
+  for (ssize_t i = 0; i < CORNERS; i++)
+    row_x[i] = static_cast<float>(min_i + i) * UNIT;
+  for (ssize_t j = 0; j < CORNERS; j++)
+  {
+    row_z.fill(static_cast<float>(min_j + j) * UNIT);
+    terrain->get_y_batch(
+      row_x,
+      row_z,
+      std::span { chunk->heights }.subspan(j * CORNERS, CORNERS),
+      std::span { chunk->vertex_normals }.subspan(j * CORNERS, CORNERS));
+  }
+  const auto [min_y, max_y] = std::minmax_element(chunk->heights.begin(), chunk->heights.end());
+  chunk->min_y = *min_y;
+  chunk->max_y = *max_y;
+
+  // height bounds of the cells, every next level merges 2x2 blocks of the previous one
+  auto &cell_bounds = chunk->height_bounds[0];
+  cell_bounds.resize(CELLS * CELLS);
+  for (ssize_t j = 0; j < CELLS; j++)
+    for (ssize_t i = 0; i < CELLS; i++)
+    {
+      const auto [lo, hi] = std::minmax(
+        { chunk->height(i, j), chunk->height(i + 1, j), chunk->height(i, j + 1), chunk->height(i + 1, j + 1) });
+      cell_bounds[j * CELLS + i] = { lo, hi };
+    }
+  for (size_t level = 1; level < GroundChunk::LEVELS; level++)
+  {
+    const ssize_t blocks = CELLS >> level;
+    auto &bounds = chunk->height_bounds[level];
+    bounds.resize(blocks * blocks);
+    for (ssize_t bj = 0; bj < blocks; bj++)
+      for (ssize_t bi = 0; bi < blocks; bi++)
+      {
+        const glm::vec2 &b00 = chunk->bounds(level - 1, bi * 2, bj * 2);
+        const glm::vec2 &b10 = chunk->bounds(level - 1, bi * 2 + 1, bj * 2);
+        const glm::vec2 &b01 = chunk->bounds(level - 1, bi * 2, bj * 2 + 1);
+        const glm::vec2 &b11 = chunk->bounds(level - 1, bi * 2 + 1, bj * 2 + 1);
+        bounds[bj * blocks + bi] = { std::min({ b00.x, b10.x, b01.x, b11.x }), std::max({ b00.y, b10.y, b01.y, b11.y }) };
+      }
+  }
+
+  // skirts deep enough to cover the difference between the levels of neighbouring chunks
+  chunk->skirt_depth = (chunk->max_y - chunk->min_y) * 0.5f + UNIT;
+  const float lowest_y = chunk->min_y - chunk->skirt_depth;
+  chunk->height_origin = (lowest_y + chunk->max_y) * 0.5f;
+  chunk->height_scale = std::max(chunk->max_y - lowest_y, UNIT) / 65534.0f;
+
+  // a corner that disappears on the next level morphs into the middle of the coarser edge it lies on,
+  // the same diagonal as of the quads keeps the fully morphed mesh equal to the coarser one
+  const auto corner_level = [](const ssize_t c) {
+    return c == 0 ? GroundChunk::LEVELS - 1 : std::min<size_t>(std::countr_zero<size_t>(c), GroundChunk::LEVELS - 1);
+  };
+  chunk->vertices.resize(CORNERS * CORNERS + GroundChunk::SKIRT_VERTICES);
+  for (ssize_t j = 0; j < CORNERS; j++)
+    for (ssize_t i = 0; i < CORNERS; i++)
+    {
+      const size_t level = std::min(corner_level(i), corner_level(j));
+      float morph_y = chunk->height(i, j);
+      if (level < GroundChunk::LEVELS - 1)
+      {
+        const ssize_t step = 1 << level;
+        const bool odd_i = (i >> level) & 1;
+        const bool odd_j = (j >> level) & 1;
+        const ssize_t di = odd_i ? step : 0;
+        const ssize_t dj = odd_j ? step : 0;
+        morph_y = (chunk->height(i - di, j - dj) + chunk->height(i + di, j + dj)) * 0.5f;
+      }
+
+      chunk->vertices[j * CORNERS + i] = {
+        .x = static_cast<uint8_t>(i),
+        .z = static_cast<uint8_t>(j),
+        .level = static_cast<uint8_t>(level),
+        .unused = 0,
+        .y = chunk->quantize_height(chunk->height(i, j)),
+        .morph_y = chunk->quantize_height(morph_y),
+      };
+    }
 
-  add_model(model);
+  // skirt vertices are the border vertices moved down
+  const int16_t skirt_offset = static_cast<int16_t>(std::round(chunk->skirt_depth / chunk->height_scale));
+  for (ssize_t side = 0; side < 4; side++)
+    for (ssize_t k = 0; k < CORNERS; k++)
+    {
+      const ssize_t border = side == 0 ? k
+                             : side == 1 ? CELLS * CORNERS + k
+                             : side == 2 ? k * CORNERS
+                                         : k * CORNERS + CELLS;
+      GroundVertex skirt = chunk->vertices[border];
+      skirt.y = std::max(-32767, skirt.y - skirt_offset);
+      skirt.morph_y = std::max(-32767, skirt.morph_y - skirt_offset);
+      chunk->vertices[CORNERS * CORNERS + side * CORNERS + k] = skirt;
+    }
+
+  chunk->face_normals.resize(CELLS * CELLS * 2);
+  for (ssize_t j = 0; j < CELLS; j++)
+    for (ssize_t i = 0; i < CELLS; i++)
+    {
+      const float y00 = chunk->height(i, j);
+      const float y10 = chunk->height(i + 1, j);
+      const float y01 = chunk->height(i, j + 1);
+      const float y11 = chunk->height(i + 1, j + 1);
+      const size_t idx = (j * CELLS + i) * 2;
+      chunk->face_normals[idx] = glm::normalize(glm::vec3 { y00 - y10, UNIT, y10 - y11 });
+      chunk->face_normals[idx + 1] = glm::normalize(glm::vec3 { y01 - y11, UNIT, y00 - y01 });
+    }
+
+  return chunk;
+}
+
+void Ground::add_chunk(std::unique_ptr<GroundChunk> chunk)
+{
+  chunk->mesh.upload(chunk->vertices);
+  chunk->vertices = {};
+  bake_surface(*chunk);
+  chunk->last_used = frame;
+
+  if (Debug::enabled("Ground Normals"))
+    add_normal_lines(*chunk);
+
+  const ChunkKey key { chunk->x, chunk->z };
+  chunks.insert_or_assign(key, std::move(chunk));
+}
+
+void Ground::add_normal_lines(const GroundChunk &chunk) const
+{
+  for (ssize_t j = 0; j < GroundChunk::CELLS; j++)
+    for (ssize_t i = 0; i < GroundChunk::CELLS; i++)
+    {
+      const glm::vec3 p {
+        (chunk.x * GroundChunk::CELLS + i) * UNIT, chunk.height(i, j), (chunk.z * GroundChunk::CELLS + j) * UNIT
+      };
+      Debug::add_line("Ground Normals", p, p + chunk.vertex_normal(i, j) * 10.0f);
+    }
+}
+
+void Ground::bake_surface(GroundChunk &chunk) const
+{
+  static constexpr ssize_t CORNERS = GroundChunk::CORNERS;
+  const auto to_byte = [](const float v) {
+    return static_cast<uint8_t>(std::round(std::clamp(v, 0.0f, 1.0f) * 255.0f));
+  };
+
+  // same blend as the fragment shader used to evaluate for every fragment
+  const glm::vec4 factors = get_surface_factors();
+  std::vector<uint8_t> texels(CORNERS * CORNERS * 4);
+  for (ssize_t k = 0; k < CORNERS * CORNERS; k++)
+  {
+    const glm::vec2 normal = encode_octahedral(chunk.vertex_normals[k]) * 0.5f + 0.5f;
+    const float y = chunk.heights[k];
+    texels[k * 4 + 0] = to_byte(normal.x);
+    texels[k * 4 + 1] = to_byte(normal.y);
+    texels[k * 4 + 2] = to_byte((y + factors.x) / factors.y);
+    texels[k * 4 + 3] = to_byte((factors.z + y) / factors.w);
+  }
+  chunk.surface.upload(CORNERS, texels);
+  chunk.surface_factors = factors;
+}
+
+Ground::ChunkKey Ground::get_chunk_key(const float x, const float z) const
+{
+  return { floor_div(static_cast<ssize_t>(std::floor(x / UNIT)), GroundChunk::CELLS),
+           floor_div(static_cast<ssize_t>(std::floor(z / UNIT)), GroundChunk::CELLS) };
+}
+
+Ground::StreamingChanges Ground::update(const glm::vec3 &focus)
+{
+  StreamingChanges changes;
+  frame++;
+
+  // collect chunks finished in the background
+  for (auto it = pending_chunks.begin(); it != pending_chunks.end();)
+  {
+    if (it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+      add_chunk(it->second.get());
+      changes.loaded.push_back(it->first);
+      it = pending_chunks.erase(it);
+    }
+    else
+      ++it;
+  }
+
+  // request missing chunks in the radius, the closest first
+  const auto [focus_x, focus_z] = get_chunk_key(focus.x, focus.z);
+  const auto distance = [&](const ChunkKey &key) {
+    return std::max(std::abs(key.first - focus_x), std::abs(key.second - focus_z));
+  };
+
+  std::vector<ChunkKey> missing;
+  for (ssize_t z = focus_z - chunk_radius; z <= focus_z + chunk_radius; z++)
+    for (ssize_t x = focus_x - chunk_radius; x <= focus_x + chunk_radius; x++)
+    {
+      const auto chunk_it = chunks.find({ x, z });
+      if (chunk_it != chunks.end())
+        chunk_it->second->last_used = frame;
+      else
+        missing.push_back({ x, z });
+    }
+  std::sort(missing.begin(), missing.end(), [&](const auto &a, const auto &b) { return distance(a) < distance(b); });
+
+  const size_t max_pending = std::max(1u, std::thread::hardware_concurrency());
+  for (const auto &key : missing)
+  {
+    const auto pending_it = pending_chunks.find(key);
+
+    // the ground right around the focus point has to exist immediately
+    if (distance(key) <= 1)
+    {
+      if (pending_it != pending_chunks.end())
+      {
+        add_chunk(pending_it->second.get());
+        pending_chunks.erase(pending_it);
+      }
+      else
+        add_chunk(load_chunk(key.first, key.second));
+      changes.loaded.push_back(key);
+      continue;
+    }
+
+    if (pending_it == pending_chunks.end() && pending_chunks.size() < max_pending)
+    {
+      pending_chunks.insert(
+        { key, std::async(std::launch::async, &Ground::load_chunk, this, key.first, key.second) });
+    }
+  }
+
+  // evict the least recently used chunks outside of the radius
+  if (chunks.size() > chunk_cache_size)
+  {
+    std::vector<std::pair<size_t, ChunkKey>> unused;
+    for (const auto &[key, chunk] : chunks)
+      if (chunk->last_used != frame)
+        unused.push_back({ chunk->last_used, key });
+    std::sort(unused.begin(), unused.end());
+
+    for (size_t i = 0; i < unused.size() && chunks.size() > chunk_cache_size; i++)
+    {
+      chunks.erase(unused[i].second);
+      changes.evicted.push_back(unused[i].second);
+    }
+  }
+
+  // the lines of the evicted chunks cannot be told apart, the group is rebuilt from the loaded ones
+  if (!changes.evicted.empty() && Debug::enabled("Ground Normals"))
+  {
+    Debug::clear_lines("Ground Normals");
+    for (const auto &[key, chunk] : chunks)
+      add_normal_lines(*chunk);
+  }
+
+  return changes;
+}
+
+// after the units of the diffuse textures bound by the entity
+static constexpr GLuint SURFACE_TEXTURE_UNIT { 3 };
+
+void Ground::set_shared_uniforms(ZD::ShaderProgram &shader) const
+{
+  shader.set_uniform<glm::vec3>("fog_color", fog_color);
+  shader.set_uniform<float>("fog_scattering", 1.25);
+  shader.set_uniform<float>("fog_extinction", 0.001);
+  shader.set_uniform<float>("stones_factor", stones_factor);
+  shader.set_uniform<float>("grass_factor", grass_factor);
+  shader.set_uniform<float>("stones_blur", stones_blur);
+  shader.set_uniform<float>("grass_blur", grass_blur);
+  shader.set_uniform<float>("unit", UNIT);
+}
+
+std::pair<size_t, float> Ground::get_chunk_level(const GroundChunk &chunk, const glm::vec3 &camera) const
+{
+  if (!lod_enabled)
+    return { 0, 0.0f };
+
+  // distance to the closest point of the chunk bounds
+  const float chunk_size = get_chunk_size();
+  const float min_x = chunk.x * chunk_size;
+  const float min_z = chunk.z * chunk_size;
+  const glm::vec3 closest { std::clamp(camera.x, min_x, min_x + chunk_size),
+                            std::clamp(camera.y, chunk.min_y, chunk.max_y),
+                            std::clamp(camera.z, min_z, min_z + chunk_size) };
+  const float distance = std::max(glm::distance(camera, closest), lod_distance);
+
+  // the level doubles with the distance, the last part of every range morphs into the next level
+  static constexpr float MORPH_RANGE = 0.3f;
+  const float lod = std::log2(distance / lod_distance);
+  const size_t level = std::min(static_cast<size_t>(lod), GroundChunk::LEVELS - 1);
+  if (level == GroundChunk::LEVELS - 1)
+    return { level, 0.0f };
+  return { level, std::clamp((lod - level - (1.0f - MORPH_RANGE)) / MORPH_RANGE, 0.0f, 1.0f) };
 }
 
 void Ground::draw(const ZD::View &view)
 {
+  if (clipmap_enabled)
+  {
+    draw_clipmap(view);
+    return;
+  }
+
   shader->use();
-  shader->set_uniform<glm::vec3>("fog_color", fog_color);
-  shader->set_uniform<float>("fog_scattering", 1.25);
-  shader->set_uniform<float>("fog_extinction", 0.001);
-  shader->set_uniform<float>("stones_factor", stones_factor);
-  shader->set_uniform<float>("grass_factor", grass_factor);
-  shader->set_uniform<float>("stones_blur", stones_blur);
-  shader->set_uniform<float>("grass_blur", grass_blur);
+  set_shared_uniforms(*shader);
+  shader->set_uniform<float>("surface_size", static_cast<float>(GroundChunk::CORNERS));
+  shader->set_uniform<int>("surface", SURFACE_TEXTURE_UNIT);
+
+  // the entity has no model, rendering it only binds the textures and the transformation
   Entity::render(*shader, view);
+
+  drawn_chunks = 0;
+  drawn_triangles = 0;
+  occluded_chunks = 0;
+  full_detail_triangles = chunks.size() * level_indices[0].get_count(false) / 3;
+  const Frustum frustum(view);
+  const glm::vec3 camera = view.get_position();
+  const float chunk_size = get_chunk_size();
+  const glm::vec4 surface_factors = get_surface_factors();
+  for (const auto &[key, chunk] : chunks)
+  {
+    const float min_x = chunk->x * chunk_size;
+    const float min_z = chunk->z * chunk_size;
+    // the morphed vertices stay between the heights of the corners, the skirts hang below them
+    if (
+      frustum_culling && !frustum.contains_box(
+                           { min_x, chunk->min_y - chunk->skirt_depth, min_z },
+                           { min_x + chunk_size, chunk->max_y, min_z + chunk_size }))
+      continue;
+
+    if (
+      occlusion_culling &&
+      occlusion.is_occluded(
+        { min_x, chunk->min_y - chunk->skirt_depth, min_z }, { min_x + chunk_size, chunk->max_y, min_z + chunk_size }))
+    {
+      occluded_chunks++;
+      continue;
+    }
+
+    const auto [level, morph] = get_chunk_level(*chunk, camera);
+
+    // x and z in grid units, y in world units
+    const glm::vec3 chunk_origin { static_cast<float>(chunk->x * GroundChunk::CELLS),
+                                   chunk->height_origin,
+                                   static_cast<float>(chunk->z * GroundChunk::CELLS) };
+    shader->set_uniform<glm::vec3>("chunk_origin", chunk_origin);
+    shader->set_uniform<float>("height_scale", chunk->height_scale);
+    shader->set_uniform<float>("lod_level", static_cast<float>(level));
+    shader->set_uniform<float>("lod_morph", morph);
+    if (chunk->surface_factors != surface_factors)
+      bake_surface(*chunk);
+    chunk->surface.bind(SURFACE_TEXTURE_UNIT);
+    chunk->mesh.draw(*shader, level_indices[level], lod_enabled);
+
+    drawn_chunks++;
+    drawn_triangles += level_indices[level].get_count(lod_enabled) / 3;
+  }
+  glActiveTexture(GL_TEXTURE0);
 }
 
-float Ground::get_y(const float x, const float z) const
+void Ground::rasterize_occluders(const ZD::View &view)
 {
-  const float gx = std::floor(x / UNIT) * UNIT;
-  const float gz = std::floor(z / UNIT) * UNIT;
+  const auto start = std::chrono::steady_clock::now();
+  occlusion.clear(view.get_projection_matrix() * view.get_view_matrix());
+  occlusion_queries = 0;
+  occluded_queries = 0;
+  // the coarse rings of the clipmap span more than an occluder block and may dip below it
+  if (!occlusion_culling || clipmap_enabled)
+    return;
 
-  const auto get_noise_y = [this](const float x, const float z) -> float {
-    const float a = stb_perlin_noise3(x / 100.0f, z / 100.0f, 100.0f, 0, 0, 0) * 5.0f * UNIT;
-    const float b = stb_perlin_noise3(x / 140.0f, z / 140.0f, 100.0f, 0, 0, 0) * 8.0f * UNIT;
-    const float c = stb_perlin_noise3(x / 20.0f, z / 20.0f, 100.0f, 0, 0, 0) * 1.0f * UNIT;
-    float d = a + b - c;
-    if (d < 0.0f)
-      d *= fabs(d) / (20.0f * UNIT);
-    const float e = stb_perlin_noise3(x / 50.0f, z / 60.0f, 100.0f, 0, 0, 0) * 0.2f * UNIT;
-    return d + e;
-  };
+  const Frustum frustum(view);
+  const glm::vec3 camera = view.get_position();
+  const float chunk_size = get_chunk_size();
+  for (const auto &[key, chunk] : chunks)
+  {
+    const float min_x = chunk->x * chunk_size;
+    const float min_z = chunk->z * chunk_size;
+    if (!frustum.contains_box({ min_x, chunk->min_y, min_z }, { min_x + chunk_size, chunk->max_y, min_z + chunk_size }))
+      continue;
+
+    // the surface inside of a block never goes below its lowest corner, not even when drawn with fewer triangles
+    // as long as the triangles do not span more than a block, the vertical walls close the steps between blocks
+    const auto [level, morph] = get_chunk_level(*chunk, camera);
+    const size_t block_level = std::max<size_t>(2, level + (morph > 0.0f ? 1 : 0));
+    if (block_level >= GroundChunk::LEVELS)
+      continue;
+    const ssize_t blocks = GroundChunk::CELLS >> block_level;
+    const float block_size = UNIT * static_cast<float>(1 << block_level);
+    const auto neighbour_y = [&](const ssize_t bi, const ssize_t bj) -> std::optional<float> {
+      if (bi < blocks && bj < blocks)
+        return chunk->bounds(block_level, bi, bj).x;
+      const auto neighbour = chunks.find({ chunk->x + (bi >= blocks ? 1 : 0), chunk->z + (bj >= blocks ? 1 : 0) });
+      if (neighbour == chunks.end())
+        return std::nullopt;
+      return neighbour->second->bounds(block_level, bi % blocks, bj % blocks).x;
+    };
+
+    for (ssize_t bj = 0; bj < blocks; bj++)
+      for (ssize_t bi = 0; bi < blocks; bi++)
+      {
+        const float y = chunk->bounds(block_level, bi, bj).x;
+        const float x0 = min_x + bi * block_size;
+        const float z0 = min_z + bj * block_size;
+        const float x1 = x0 + block_size;
+        const float z1 = z0 + block_size;
+        occlusion.add_quad({ x0, y, z0 }, { x1, y, z0 }, { x1, y, z1 }, { x0, y, z1 });
+        if (const auto y_x = neighbour_y(bi + 1, bj); y_x && *y_x != y)
+          occlusion.add_quad({ x1, y, z0 }, { x1, y, z1 }, { x1, *y_x, z1 }, { x1, *y_x, z0 });
+        if (const auto y_z = neighbour_y(bi, bj + 1); y_z && *y_z != y)
+          occlusion.add_quad({ x0, y, z1 }, { x1, y, z1 }, { x1, *y_z, z1 }, { x0, *y_z, z1 });
+      }
+  }
+  occlusion_time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool Ground::is_occluded(const glm::vec3 &min, const glm::vec3 &max) const
+{
+  if (!occlusion_culling || clipmap_enabled)
+    return false;
+  occlusion_queries++;
+  const bool occluded = occlusion.is_occluded(min, max);
+  occluded_queries += occluded;
+  return occluded;
+}
+
+void Ground::draw_clipmap(const ZD::View &view)
+{
+  clipmap_shader->use();
+  set_shared_uniforms(*clipmap_shader);
+  Entity::render(*clipmap_shader, view);
+
+  // every level is drawn whole, the frustum of the camera covers a large part of the rings anyway
+  clipmap->update(view.get_position());
+  clipmap->draw(*clipmap_shader, SURFACE_TEXTURE_UNIT);
+
+  drawn_chunks = 0;
+  occluded_chunks = 0;
+  drawn_triangles = clipmap->get_triangles_count();
+  full_detail_triangles = drawn_triangles;
+}
 
-  const float px = (x - gx) / UNIT;
-  const float pz = (z - gz) / UNIT;
+// entry distance of the ray into the box, nullopt when it misses it before max_t
+static std::optional<float> intersect_box(
+  const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &min, const glm::vec3 &max, const float max_t)
+{
+  float t_enter = 0.0f;
+  float t_exit = max_t;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    if (direction[axis] == 0.0f)
+    {
+      if (origin[axis] < min[axis] || origin[axis] > max[axis])
+        return std::nullopt;
+      continue;
+    }
 
-  if (px == 0.0 && pz == 0.0)
-    return get_noise_y(gx, gz);
+    float t0 = (min[axis] - origin[axis]) / direction[axis];
+    float t1 = (max[axis] - origin[axis]) / direction[axis];
+    if (t0 > t1)
+      std::swap(t0, t1);
+    t_enter = std::max(t_enter, t0);
+    t_exit = std::min(t_exit, t1);
+    if (t_enter > t_exit)
+      return std::nullopt;
+  }
+  return t_enter;
+}
 
-  // interpolation for fractional values
-  const float y00 = get_noise_y(gx, gz);
-  const float y10 = px > pz ? get_noise_y(gx + UNIT, gz) : get_noise_y(gx, gz + UNIT);
-  const float y11 = get_noise_y(gx + UNIT, gz + UNIT);
+// Moller-Trumbore, distance along the ray to the triangle
+static std::optional<float> intersect_triangle(
+  const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+  const glm::vec3 ab = b - a;
+  const glm::vec3 ac = c - a;
+  const glm::vec3 p = glm::cross(direction, ac);
+  const float det = glm::dot(ab, p);
+  if (std::fabs(det) < 1e-8f)
+    return std::nullopt;
 
-  if ((px == 1.0 && pz == 0.0) || (px == 0.0 && pz == 1.0))
-    return y10;
+  const float inv_det = 1.0f / det;
+  const glm::vec3 s = origin - a;
+  const float u = glm::dot(s, p) * inv_det;
+  if (u < 0.0f || u > 1.0f)
+    return std::nullopt;
 
-  const float xv1 = 0.0f;
-  const float yv1 = 0.0f;
-  const float xv2 = px > pz ? 1.0f : 0.0f;
-  const float yv2 = px > pz ? 0.0f : 1.0f;
-  const float xv3 = 1.0f;
-  const float yv3 = 1.0f;
+  const glm::vec3 q = glm::cross(s, ab);
+  const float v = glm::dot(direction, q) * inv_det;
+  if (v < 0.0f || u + v > 1.0f)
+    return std::nullopt;
 
-  const float b = (yv2 - yv3) * (xv1 - xv3) + (xv3 - xv2) * (yv1 - yv3);
-  const float w1 = ((yv2 - yv3) * (px - xv3) + (xv3 - xv2) * (pz - yv3)) / b;
-  const float w2 = ((yv3 - yv1) * (px - xv3) + (xv1 - xv3) * (pz - yv3)) / b;
-  const float w3 = 1.0f - w1 - w2;
+  const float t = glm::dot(ac, q) * inv_det;
+  if (t < 0.0f)
+    return std::nullopt;
+  return t;
+}
+
+// descends the height bounds of a chunk visiting the closer blocks first,
+// best_t shrinks with every hit so that farther blocks are skipped
+static void raycast_block(
+  const GroundChunk &chunk,
+  const size_t level,
+  const ssize_t bi,
+  const ssize_t bj,
+  const glm::vec3 &origin,
+  const glm::vec3 &direction,
+  const float unit,
+  std::optional<GroundHit> &best,
+  float &best_t)
+{
+  static constexpr ssize_t CELLS = GroundChunk::CELLS;
+  const ssize_t size = ssize_t { 1 } << level;
+  const ssize_t i = chunk.x * CELLS + bi * size;
+  const ssize_t j = chunk.z * CELLS + bj * size;
+
+  if (level == 0)
+  {
+    const float x0 = static_cast<float>(i) * unit;
+    const float z0 = static_cast<float>(j) * unit;
+    const glm::vec3 v00 { x0, chunk.height(bi, bj), z0 };
+    const glm::vec3 v10 { x0 + unit, chunk.height(bi + 1, bj), z0 };
+    const glm::vec3 v01 { x0, chunk.height(bi, bj + 1), z0 + unit };
+    const glm::vec3 v11 { x0 + unit, chunk.height(bi + 1, bj + 1), z0 + unit };
+
+    for (const bool lower : { true, false })
+    {
+      const auto t = lower ? intersect_triangle(origin, direction, v00, v10, v11)
+                           : intersect_triangle(origin, direction, v00, v11, v01);
+      if (t && *t <= best_t)
+      {
+        best_t = *t;
+        best = GroundHit { origin + direction * *t, chunk.face_normal(bi, bj, lower), i, j, *t };
+      }
+    }
+    return;
+  }
+
+  const ssize_t child_size = size / 2;
+  std::array<std::pair<float, std::pair<ssize_t, ssize_t>>, 4> children;
+  size_t children_count = 0;
+  for (ssize_t cj = bj * 2; cj < bj * 2 + 2; cj++)
+    for (ssize_t ci = bi * 2; ci < bi * 2 + 2; ci++)
+    {
+      const glm::vec2 &bounds = chunk.bounds(level - 1, ci, cj);
+      const glm::vec3 min { static_cast<float>(chunk.x * CELLS + ci * child_size) * unit,
+                            bounds.x,
+                            static_cast<float>(chunk.z * CELLS + cj * child_size) * unit };
+      const glm::vec3 max { min.x + child_size * unit, bounds.y, min.z + child_size * unit };
+      if (const auto t = intersect_box(origin, direction, min, max, best_t))
+        children[children_count++] = { *t, { ci, cj } };
+    }
+  std::sort(children.begin(), children.begin() + children_count);
+
+  for (size_t c = 0; c < children_count; c++)
+  {
+    // a closer hit was found in the previous blocks
+    if (children[c].first > best_t)
+      break;
+    raycast_block(
+      chunk, level - 1, children[c].second.first, children[c].second.second, origin, direction, unit, best, best_t);
+  }
+}
+
+std::optional<GroundHit>
+  Ground::raycast(const glm::vec3 &origin, const glm::vec3 &direction, const float max_distance) const
+{
+  std::optional<GroundHit> best;
+  float best_t = max_distance;
+
+  // walks the chunks crossed by the ray in the order of the crossing
+  const float chunk_size = get_chunk_size();
+  auto [cx, cz] = get_chunk_key(origin.x, origin.z);
+  const ssize_t step_x = direction.x > 0.0f ? 1 : -1;
+  const ssize_t step_z = direction.z > 0.0f ? 1 : -1;
+  const float delta_x = direction.x != 0.0f ? chunk_size / std::fabs(direction.x) : INFINITY;
+  const float delta_z = direction.z != 0.0f ? chunk_size / std::fabs(direction.z) : INFINITY;
+  const float next_x = static_cast<float>(cx + (step_x > 0 ? 1 : 0)) * chunk_size;
+  const float next_z = static_cast<float>(cz + (step_z > 0 ? 1 : 0)) * chunk_size;
+  float t_x = direction.x != 0.0f ? (next_x - origin.x) / direction.x : INFINITY;
+  float t_z = direction.z != 0.0f ? (next_z - origin.z) / direction.z : INFINITY;
+  float t_chunk = 0.0f;
+
+  while (t_chunk <= best_t)
+  {
+    const auto chunk_it = chunks.find({ cx, cz });
+    if (chunk_it != chunks.end())
+    {
+      const GroundChunk &chunk = *chunk_it->second;
+      const glm::vec3 min { static_cast<float>(cx) * chunk_size, chunk.min_y, static_cast<float>(cz) * chunk_size };
+      const glm::vec3 max { min.x + chunk_size, chunk.max_y, min.z + chunk_size };
+      if (intersect_box(origin, direction, min, max, best_t))
+        raycast_block(chunk, GroundChunk::LEVELS - 1, 0, 0, origin, direction, UNIT, best, best_t);
+    }
+
+    // the hit is in the closest chunk containing one
+    if (best)
+      break;
+
+    if (t_x < t_z)
+    {
+      t_chunk = t_x;
+      t_x += delta_x;
+      cx += step_x;
+    }
+    else
+    {
+      t_chunk = t_z;
+      t_z += delta_z;
+      cz += step_z;
+    }
+    if (std::isinf(t_chunk))
+      break;
+  }
 
-  return w1 * y00 + w2 * y10 + w3 * y11;
+  return best;
 }
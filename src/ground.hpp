@@ -1,37 +1,249 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
 #include "ZD/Entity.hpp"
 
+#include "occlusion.hpp"
+#include "terrain.hpp"
+
 struct Debug;
-struct ConfigKeysValues;
+class GroundClipmap;
 
-class Ground : public ZD::Entity
+// 8 bytes per vertex, the shader rebuilds the position and uv from the chunk origin,
+// normals come from the surface texture of the chunk
+struct GroundVertex
+{
+  uint8_t x, z; // corner inside of the chunk
+  uint8_t level; // coarsest level the vertex is part of
+  uint8_t unused;
+  int16_t y, morph_y; // quantized heights, morph_y is the height of the coarser level at this position
+};
+static_assert(sizeof(GroundVertex) == 8);
+
+// GL index buffer of one detail level shared by the meshes of all chunks,
+// the skirts hiding cracks between chunks of different levels follow the surface
+class GroundIndices final
 {
 public:
-  Ground(const ConfigKeysValues &world_config);
+  GroundIndices() = default;
+  GroundIndices(const GroundIndices &) = delete;
+  GroundIndices &operator=(const GroundIndices &) = delete;
+  ~GroundIndices();
 
-  std::shared_ptr<ZD::ShaderProgram> get_shader_program() const { return shader; }
+  void upload(const std::vector<GLuint> &surface, const std::vector<GLuint> &skirts);
+  inline GLuint get_buffer() const { return index_buffer; }
+  inline size_t get_count(const bool with_skirts) const { return with_skirts ? indices_count : surface_count; }
+
+private:
+  GLuint index_buffer { 0 };
+  size_t surface_count { 0 };
+  size_t indices_count { 0 };
+};
+
+// vertices of a part of the ground kept in a GL buffer
+class GroundMesh final
+{
+public:
+  GroundMesh() = default;
+  GroundMesh(const GroundMesh &) = delete;
+  GroundMesh &operator=(const GroundMesh &) = delete;
+  ~GroundMesh();
+
+  void upload(const std::vector<GroundVertex> &vertices);
+  void draw(ZD::ShaderProgram &shader, const GroundIndices &indices, const bool with_skirts) const;
+
+  inline size_t get_vertices_count() const { return vertices_count; }
 
-  float get_y(const float x, const float z) const;
+private:
+  GLuint vertex_buffer { 0 };
+  size_t vertices_count { 0 };
+};
+
+// GL texture with a texel per corner of a chunk, the octahedral normal in RG and the splat weights
+// of the stones and grass textures in BA, sampled once per fragment
+class GroundSurface final
+{
+public:
+  GroundSurface() = default;
+  GroundSurface(const GroundSurface &) = delete;
+  GroundSurface &operator=(const GroundSurface &) = delete;
+  ~GroundSurface();
+
+  // size * size RGBA texels
+  void upload(const size_t size, const std::vector<uint8_t> &texels);
+  void bind(const GLuint unit) const;
 
-  glm::vec3 get_n(const float x, const float z) const
+private:
+  GLuint texture { 0 };
+};
+
+// square part of the ground generated and streamed independently
+struct GroundChunk
+{
+  static constexpr ssize_t CELLS { 32 }; // quads along a side
+  static constexpr ssize_t CORNERS { CELLS + 1 };
+  static constexpr size_t LEVELS { 6 }; // level n skips 2^n - 1 corners, the last one is a single quad
+  static constexpr size_t SKIRT_VERTICES { CORNERS * 4 }; // after the surface vertices
+
+  GroundChunk(const ssize_t x, const ssize_t z)
+  : x { x }
+  , z { z }
   {
-    const glm::vec3 a { x, get_y(x, z), z };
-    const glm::vec3 b { x + UNIT, get_y(x + UNIT, z), z };
-    const glm::vec3 c { x, get_y(x, z + UNIT), z + UNIT };
-    return glm::normalize(glm::cross(c - a, b - a));
   }
 
+  // chunk coordinates, the first corner is at (x * CELLS, z * CELLS) of the UNIT grid
+  const ssize_t x;
+  const ssize_t z;
+
+  std::vector<float> heights; // CORNERS * CORNERS, row-major in z
+  std::vector<glm::vec3> vertex_normals; // CORNERS * CORNERS
+  std::vector<glm::vec3> face_normals; // CELLS * CELLS * 2, lower triangle (x > z inside of the quad) first
+  std::vector<GroundVertex> vertices; // released after the upload
+  float min_y { 0.0f };
+  float max_y { 0.0f };
+  float skirt_depth { 0.0f };
+  // vertex heights are height_origin + y * height_scale, the range covers the skirts
+  float height_origin { 0.0f };
+  float height_scale { 1.0f };
+  // min/max heights over square blocks of 2^n cells, level 0 are single cells and the last level the whole chunk
+  std::array<std::vector<glm::vec2>, LEVELS> height_bounds;
+
+  GroundMesh mesh;
+  GroundSurface surface;
+  std::optional<glm::vec4> surface_factors; // splat factors the surface was baked with
+  size_t last_used { 0 };
+
+  inline float height(const ssize_t li, const ssize_t lj) const { return heights[lj * CORNERS + li]; }
+  inline int16_t quantize_height(const float y) const
+  {
+    return static_cast<int16_t>(std::clamp(std::round((y - height_origin) / height_scale), -32767.0f, 32767.0f));
+  }
+  inline const glm::vec3 &vertex_normal(const ssize_t li, const ssize_t lj) const
+  {
+    return vertex_normals[lj * CORNERS + li];
+  }
+  inline const glm::vec2 &bounds(const size_t level, const ssize_t bi, const ssize_t bj) const
+  {
+    return height_bounds[level][bj * (CELLS >> level) + bi];
+  }
+  inline const glm::vec3 &face_normal(const ssize_t li, const ssize_t lj, const bool lower) const
+  {
+    return face_normals[(lj * CELLS + li) * 2 + (lower ? 0 : 1)];
+  }
+};
+
+struct GroundHit
+{
+  glm::vec3 position;
+  glm::vec3 normal; // of the hit triangle
+  ssize_t i, j; // first corner of the hit quad on the UNIT grid
+  float distance;
+};
+
+class Ground : public ZD::Entity
+{
+public:
+  using ChunkKey = std::pair<ssize_t, ssize_t>;
+
+  struct StreamingChanges
+  {
+    std::vector<ChunkKey> loaded;
+    std::vector<ChunkKey> evicted;
+  };
+
+  // renders the terrain field, height queries go to the field directly
+  Ground(const ConfigKeysValues &world_config, std::shared_ptr<const TerrainField> terrain);
+  ~Ground();
+
+  std::shared_ptr<ZD::ShaderProgram> get_shader_program() const { return shader; }
+  const TerrainField &get_terrain() const { return *terrain; }
+
+  // first intersection with the triangles of the loaded chunks, the direction has to be normalized
+  std::optional<GroundHit>
+    raycast(const glm::vec3 &origin, const glm::vec3 &direction, const float max_distance = 1000.0f) const;
+
+  // loads chunks around the focus point on background threads and evicts the least recently used far ones
+  StreamingChanges update(const glm::vec3 &focus);
+  // chunks are read from and saved to the directory, an empty path disables the cache
+  void set_cache(const std::filesystem::path &directory, const uint64_t key);
+  ChunkKey get_chunk_key(const float x, const float z) const;
+  float get_chunk_size() const { return GroundChunk::CELLS * UNIT; }
+
+  // draws the chunks in the view frustum, the detail level of every chunk depends on its distance to the camera,
+  // or the clipmap centred on the camera when it is enabled
   void draw(const ZD::View &view);
+  // fills the occlusion buffer with boxes under the surface of the loaded chunks, before anything is drawn
+  void rasterize_occluders(const ZD::View &view);
+  // true when the box is hidden behind the ground rasterized for this frame
+  bool is_occluded(const glm::vec3 &min, const glm::vec3 &max) const;
 
   void set_fog_color(const ZD::Color color)
   {
     fog_color = { color.red_float(), color.green_float(), color.blue_float() };
   }
 
-  const float UNIT { 10.0f };
+  const float UNIT;
 
 private:
+  // reads the chunk from the cache or generates and saves it
+  std::unique_ptr<GroundChunk> load_chunk(const ssize_t x, const ssize_t z) const;
+  std::unique_ptr<GroundChunk> generate_chunk(const ssize_t x, const ssize_t z) const;
+  std::unique_ptr<GroundChunk> read_chunk(const ssize_t x, const ssize_t z) const;
+  void save_chunk(const GroundChunk &chunk) const;
+  void add_chunk(std::unique_ptr<GroundChunk> chunk);
+  // debug lines of the vertex normals of the chunk
+  void add_normal_lines(const GroundChunk &chunk) const;
+  // splat weights follow the Ground properties, the surface is baked again when they change
+  glm::vec4 get_surface_factors() const { return { stones_factor, stones_blur, grass_factor, grass_blur }; }
+  void bake_surface(GroundChunk &chunk) const;
+  void set_shared_uniforms(ZD::ShaderProgram &shader) const;
+  void draw_clipmap(const ZD::View &view);
+  // detail level of the chunk and how far it is morphed into the next one
+  std::pair<size_t, float> get_chunk_level(const GroundChunk &chunk, const glm::vec3 &camera) const;
+
+  std::shared_ptr<const TerrainField> terrain;
+  std::map<ChunkKey, std::unique_ptr<GroundChunk>> chunks;
+  std::map<ChunkKey, std::future<std::unique_ptr<GroundChunk>>> pending_chunks;
+  std::array<GroundIndices, GroundChunk::LEVELS> level_indices;
+  ssize_t chunk_radius { 3 };
+  size_t chunk_cache_size { 128 };
+  size_t frame { 0 };
+
+  std::filesystem::path cache_directory;
+  uint64_t cache_key { 0 };
+  mutable std::atomic<size_t> chunks_read { 0 };
+  mutable std::atomic<size_t> chunks_generated { 0 };
+
+  bool frustum_culling { true };
+  bool lod_enabled { true };
+  float lod_distance { 150.0f }; // chunks closer than that are drawn with all the triangles
+  size_t drawn_chunks { 0 };
+  size_t drawn_triangles { 0 };
+  size_t full_detail_triangles { 0 };
+
+  OcclusionBuffer occlusion { 256, 128 };
+  bool occlusion_culling { true };
+  size_t occluded_chunks { 0 };
+  mutable size_t occlusion_queries { 0 }; // made through is_occluded since the last rasterization
+  mutable size_t occluded_queries { 0 };
+  float occlusion_time { 0.0f }; // of the rasterization in milliseconds
+
+  // alternative renderer for large view distances, the chunks are still streamed for the queries and raycasts
+  std::unique_ptr<GroundClipmap> clipmap;
+  std::shared_ptr<ZD::ShaderProgram> clipmap_shader;
+  bool clipmap_enabled { false };
+
   std::shared_ptr<ZD::ShaderProgram> shader;
   glm::vec3 fog_color { 0.88, 0.94, 1.0 };
   float stones_factor { 2.0f };
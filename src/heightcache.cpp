@@ -0,0 +1,138 @@
+#include "heightcache.hpp"
+
+#include <algorithm>
+#include <bit>
+
+static inline ssize_t floor_div(const ssize_t a, const ssize_t b)
+{
+  return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+HeightTileCache::HeightTileCache(const NoiseStack &noise, const float unit, const size_t capacity)
+: noise { noise }
+, unit { unit }
+, sets_n { std::bit_ceil(std::max<size_t>(1, (capacity + WAYS - 1) / WAYS)) }
+, slots { std::make_unique<Slot[]>(sets_n * WAYS) }
+{
+}
+
+QuadCorners HeightTileCache::get_quad(const ssize_t i, const ssize_t j)
+{
+  const ssize_t ti = floor_div(i, TILE_CELLS);
+  const ssize_t tj = floor_div(j, TILE_CELLS);
+  const ssize_t li = i - ti * TILE_CELLS;
+  const ssize_t lj = j - tj * TILE_CELLS;
+  const uint64_t hash =
+    (static_cast<uint64_t>(ti) * 0x9e3779b97f4a7c15ull) ^ (static_cast<uint64_t>(tj) * 0xc2b2ae3d27d4eb4full);
+  Slot *set = &slots[((hash >> 32) & (sets_n - 1)) * WAYS];
+  const uint64_t now = queries.fetch_add(1, std::memory_order_relaxed) + 1;
+
+  QuadCorners quad;
+  for (size_t way = 0; way < WAYS; way++)
+    if (read_quad(set[way], ti, tj, li, lj, quad))
+    {
+      set[way].last_used.store(now, std::memory_order_relaxed);
+      return quad;
+    }
+
+  misses.fetch_add(1, std::memory_order_relaxed);
+  Tile tile;
+  generate_tile(ti, tj, tile);
+
+  Slot *victim = &set[0];
+  for (size_t way = 1; way < WAYS; way++)
+    if (set[way].last_used.load(std::memory_order_relaxed) < victim->last_used.load(std::memory_order_relaxed))
+      victim = &set[way];
+  write_tile(*victim, ti, tj, tile, now);
+
+  for (size_t c = 0; c < 4; c++)
+  {
+    const size_t k = (lj + c / 2) * TILE_CORNERS + li + c % 2;
+    quad.y[c] = tile.heights[k];
+    quad.n[c] = tile.normals[k];
+  }
+  return quad;
+}
+
+void HeightTileCache::generate_tile(const ssize_t ti, const ssize_t tj, Tile &tile) const
+{
+  std::array<float, TILE_N> x, z;
+  for (ssize_t lj = 0; lj < TILE_CORNERS; lj++)
+    for (ssize_t li = 0; li < TILE_CORNERS; li++)
+    {
+      x[lj * TILE_CORNERS + li] = static_cast<float>(ti * TILE_CELLS + li) * unit;
+      z[lj * TILE_CORNERS + li] = static_cast<float>(tj * TILE_CELLS + lj) * unit;
+    }
+  noise.evaluate_batch(x, z, tile.heights, tile.normals);
+}
+
+bool HeightTileCache::read_quad(
+  const Slot &slot, const ssize_t ti, const ssize_t tj, const ssize_t li, const ssize_t lj, QuadCorners &quad) const
+{
+  const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+  if (sequence == 0 || (sequence & 1) != 0)
+    return false;
+  if (slot.ti.load(std::memory_order_relaxed) != ti || slot.tj.load(std::memory_order_relaxed) != tj)
+    return false;
+
+  for (size_t c = 0; c < 4; c++)
+  {
+    const size_t k = ((lj + c / 2) * TILE_CORNERS + li + c % 2) * 4;
+    quad.y[c] = slot.corners[k].load(std::memory_order_relaxed);
+    quad.n[c] = { slot.corners[k + 1].load(std::memory_order_relaxed),
+                  slot.corners[k + 2].load(std::memory_order_relaxed),
+                  slot.corners[k + 3].load(std::memory_order_relaxed) };
+  }
+
+  // the values are only valid when no writer started meanwhile
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+bool HeightTileCache::write_tile(Slot &slot, const ssize_t ti, const ssize_t tj, const Tile &tile, const uint64_t now)
+{
+  // another writer owns the slot, the tile is simply not cached
+  uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  if ((sequence & 1) != 0 || !slot.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire))
+    return false;
+  std::atomic_thread_fence(std::memory_order_release);
+
+  if (sequence != 0)
+    evictions.fetch_add(1, std::memory_order_relaxed);
+  slot.ti.store(ti, std::memory_order_relaxed);
+  slot.tj.store(tj, std::memory_order_relaxed);
+  slot.last_used.store(now, std::memory_order_relaxed);
+  for (size_t k = 0; k < TILE_N; k++)
+  {
+    slot.corners[k * 4].store(tile.heights[k], std::memory_order_relaxed);
+    slot.corners[k * 4 + 1].store(tile.normals[k].x, std::memory_order_relaxed);
+    slot.corners[k * 4 + 2].store(tile.normals[k].y, std::memory_order_relaxed);
+    slot.corners[k * 4 + 3].store(tile.normals[k].z, std::memory_order_relaxed);
+  }
+
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+  return true;
+}
+
+HeightTileCache::Stats HeightTileCache::get_stats() const
+{
+  size_t tiles = 0;
+  for (size_t s = 0; s < sets_n * WAYS; s++)
+    tiles += slots[s].sequence.load(std::memory_order_relaxed) != 0;
+
+  const uint64_t misses_n = misses.load(std::memory_order_relaxed);
+  const uint64_t queries_n = queries.load(std::memory_order_relaxed) - queries_reset.load(std::memory_order_relaxed);
+  return Stats { .hits = queries_n > misses_n ? queries_n - misses_n : 0,
+                 .misses = misses_n,
+                 .evictions = evictions.load(std::memory_order_relaxed),
+                 .tiles = tiles,
+                 .capacity = sets_n * WAYS };
+}
+
+void HeightTileCache::reset_stats()
+{
+  // the clock keeps running
+  queries_reset.store(queries.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  misses.store(0, std::memory_order_relaxed);
+  evictions.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <sys/types.h>
+
+#include "ZD/3rd/glm/glm.hpp"
+
+#include "noisestack.hpp"
+
+// heights and normals of the corners of a quad of the UNIT grid in the order 00, 10, 01, 11
+struct QuadCorners
+{
+  std::array<float, 4> y;
+  std::array<glm::vec3, 4> n;
+};
+
+// bounded cache of tiles of corner heights and normals for queries at arbitrary positions,
+// tiles are generated on demand and evicted least recently used within their set
+//
+// readers never lock or allocate, every slot is guarded by a sequence number and a reader
+// that races the writer of its slot evaluates the tile itself
+class HeightTileCache final
+{
+public:
+  // tiles hold their far edges as well so that every quad is answered by a single tile
+  static constexpr ssize_t TILE_CELLS { 16 };
+  static constexpr ssize_t TILE_CORNERS { TILE_CELLS + 1 };
+  static constexpr size_t WAYS { 4 };
+
+  // the capacity is rounded up to a power of two number of sets
+  HeightTileCache(const NoiseStack &noise, const float unit, const size_t capacity);
+
+  // corners of the quad with the first corner i, j
+  QuadCorners get_quad(const ssize_t i, const ssize_t j);
+
+  struct Stats
+  {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t tiles;
+    size_t capacity;
+  };
+  Stats get_stats() const;
+  void reset_stats();
+
+private:
+  static constexpr size_t TILE_N { TILE_CORNERS * TILE_CORNERS };
+
+  struct Tile
+  {
+    std::array<float, TILE_N> heights;
+    std::array<glm::vec3, TILE_N> normals;
+  };
+
+  struct Slot
+  {
+    std::atomic<uint64_t> sequence { 0 }; // odd while written, 0 while empty
+    std::atomic<int64_t> ti { 0 }, tj { 0 };
+    std::atomic<uint64_t> last_used { 0 };
+    std::array<std::atomic<float>, TILE_N * 4> corners; // height followed by the normal of every corner
+  };
+
+  void generate_tile(const ssize_t ti, const ssize_t tj, Tile &tile) const;
+  bool read_quad(
+    const Slot &slot, const ssize_t ti, const ssize_t tj, const ssize_t li, const ssize_t lj, QuadCorners &quad) const;
+  bool write_tile(Slot &slot, const ssize_t ti, const ssize_t tj, const Tile &tile, const uint64_t now);
+
+  const NoiseStack &noise;
+  const float unit;
+  size_t sets_n;
+  std::unique_ptr<Slot[]> slots; // WAYS consecutive slots per set
+
+  std::atomic<uint64_t> queries { 0 }; // doubles as the clock of the LRU
+  std::atomic<uint64_t> queries_reset { 0 };
+  std::atomic<uint64_t> misses { 0 };
+  std::atomic<uint64_t> evictions { 0 };
+};
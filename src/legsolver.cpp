@@ -0,0 +1,968 @@
+#include "legsolver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "ZD/3rd/glm/ext/quaternion_trigonometric.hpp"
+#include "ZD/3rd/glm/gtx/quaternion.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LEG_SOLVER_X86
+#endif
+
+glm::quat rotation_between_vectors(glm::vec3 start, glm::vec3 dest)
+{
+  start = normalize(start);
+  dest = normalize(dest);
+
+  float cosTheta = dot(start, dest);
+  glm::vec3 rotationAxis;
+
+  if (cosTheta < -1.0f + 0.001f)
+  {
+    rotationAxis = glm::cross(glm::vec3(0.0f, 0.0f, 1.0f), start);
+    if (glm::length2(rotationAxis) < 0.01f)
+      rotationAxis = glm::cross(glm::vec3(1.0f, 0.0f, 0.0f), start);
+
+    rotationAxis = normalize(rotationAxis);
+    return glm::angleAxis((float)M_PI, rotationAxis);
+  }
+
+  rotationAxis = cross(start, dest);
+
+  float s = sqrt((1.0f + cosTheta) * 2.0f);
+  float invs = 1.0f / s;
+
+  return glm::quat(s * 0.5f, rotationAxis.x * invs, rotationAxis.y * invs, rotationAxis.z * invs);
+}
+
+glm::quat rotate_lookat(glm::quat q1, glm::quat q2, float max_angle)
+{
+  if (max_angle < 0.0001f)
+    return q1;
+
+  float cosTheta = glm::dot(q1, q2);
+  if (cosTheta > 0.9999f)
+    return q2;
+
+  if (cosTheta < 0)
+  {
+    q1 = q1 * -1.0f;
+    cosTheta *= -1.0f;
+  }
+
+  float angle = glm::acos(cosTheta);
+  if (cosTheta > 0.9999f || cosTheta < -0.9999f || angle < max_angle)
+    return q2;
+
+  if (angle < 1e-4f)
+    return q2;
+
+  float fT = max_angle / angle;
+
+  angle = max_angle;
+  glm::quat res = (glm::sin((1.0f - fT) * angle) * q1 + glm::sin(fT * angle) * q2) / glm::sin(angle);
+  res = glm::normalize(res);
+  return res;
+}
+
+void LegChains::resize(const size_t n)
+{
+  for (size_t p = 0; p < LEG_PARTS; p++)
+  {
+    Part &part = parts[p];
+    for (auto *values : { &part.x, &part.y, &part.z, &part.qx, &part.qy, &part.qz })
+      values->assign(n, 0.0f);
+    for (auto *values : { &part.qw, &part.sx, &part.sy, &part.sz })
+      values->assign(n, 1.0f);
+    part.length.assign(n, LEG_LENGTHS[p]);
+  }
+  for (auto *values : { &target_x, &target_y, &target_z })
+    values->assign(n, 0.0f);
+}
+
+namespace
+{
+  struct Goals
+  {
+    const float *x, *y, *z;
+  };
+
+  bool reach_scalar(
+    LegChains::Part &part, const Goals &goals, const size_t l, const bool place_at_goal, const float max_angle)
+  {
+    const glm::vec3 goal { goals.x[l], goals.y[l], goals.z[l] };
+    if (glm::distance(goal, part.get_position(l)) <= 1e-2)
+      return false;
+
+    auto dir = glm::normalize(goal - part.get_position(l));
+    dir = glm::normalize(dir * part.get_rotation_scalar(l));
+    if (glm::isnan(dir).x)
+      return false;
+
+    part.set_rotation(l, rotate_lookat(part.get_rotation(l), rotation_between_vectors(LEG_FORWARD, dir), max_angle));
+    part.set_position(l, place_at_goal ? goal : goal - dir * part.length[l]);
+    return true;
+  }
+
+  void reach_legs_scalar(
+    LegChains::Part &part,
+    const Goals &goals,
+    const uint8_t *active,
+    const size_t begin,
+    const size_t end,
+    const bool place_at_goal,
+    const float max_angle,
+    std::vector<size_t> &moved)
+  {
+    for (size_t l = begin; l < end; l++)
+      if ((!active || active[l]) && reach_scalar(part, goals, l, place_at_goal, max_angle))
+        moved.push_back(l);
+  }
+
+  void chain_legs_scalar(
+    LegChains &legs, const glm::vec3 &root, const uint8_t *active, const size_t begin, const size_t end)
+  {
+    for (size_t l = begin; l < end; l++)
+    {
+      if (active && !active[l])
+        continue;
+      legs.parts[0].set_position(l, root);
+      for (size_t p = 1; p < LEG_PARTS; p++)
+        legs.parts[p].set_position(l, legs.parts[p - 1].get_end(l));
+    }
+  }
+
+  // direction from the point to the goal with the locked axes removed, the current one of the part when there is none
+  glm::vec3 get_fabrik_direction(
+    const LegChains::Part &part, const size_t l, const glm::vec3 &point, const glm::vec3 &goal)
+  {
+    const glm::vec3 offset = (goal - point) * part.get_rotation_scalar(l);
+    const float length = glm::length(offset);
+    if (length > 1e-6f && std::isfinite(length))
+      return offset / length;
+    return part.get_rotation(l) * LEG_FORWARD;
+  }
+
+  void fabrik_backward_scalar(
+    LegChains::Part &part,
+    const Goals &goals,
+    const uint8_t *active,
+    const size_t begin,
+    const size_t end,
+    const bool place_at_goal,
+    std::vector<size_t> &moved)
+  {
+    for (size_t l = begin; l < end; l++)
+    {
+      if (active && !active[l])
+        continue;
+
+      const glm::vec3 goal { goals.x[l], goals.y[l], goals.z[l] };
+      const glm::vec3 dir = get_fabrik_direction(part, l, part.get_position(l), goal);
+      // the rotation turns exactly only up to a little before the opposite of LEG_FORWARD,
+      // the part follows it so the chain stays connected
+      const glm::quat rotation = rotation_between_vectors(LEG_FORWARD, dir);
+      part.set_rotation(l, rotation);
+      part.set_position(l, place_at_goal ? goal : goal - rotation * LEG_FORWARD * part.length[l]);
+      moved.push_back(l);
+    }
+  }
+
+  void fabrik_forward_scalar(
+    LegChains &legs, const glm::vec3 &root, const uint8_t *active, const size_t first, const size_t last)
+  {
+    for (size_t l = first; l < last; l++)
+    {
+      if (active && !active[l])
+        continue;
+
+      // every part points at where the next one began, the foot only follows and keeps its direction
+      glm::vec3 begin = root;
+      for (size_t p = 0; p + 1 < LEG_PARTS; p++)
+      {
+        LegChains::Part &part = legs.parts[p];
+        const glm::vec3 dir = get_fabrik_direction(part, l, begin, legs.parts[p + 1].get_position(l));
+        part.set_rotation(l, rotation_between_vectors(LEG_FORWARD, dir));
+        part.set_position(l, begin);
+        begin = part.get_end(l);
+      }
+      legs.parts[LEG_PARTS - 1].set_position(l, begin);
+    }
+  }
+
+#ifdef LEG_SOLVER_X86
+
+  // Abramowitz and Stegun 4.4.46 for x in [0, 1], the error is below 2e-8
+  static constexpr float ACOS_COEFFICIENTS[8] { -0.0012624911f, 0.0066700901f, -0.0170881256f, 0.0308918810f,
+                                                -0.0501743046f, 0.0889789874f, -0.2145988016f, 1.5707963050f };
+  // odd Taylor series of sine up to x^11 on [-pi/2, pi/2]
+  static constexpr float SIN_COEFFICIENTS[5] {
+    -2.5052108e-8f, 2.7557319e-6f, -1.9841270e-4f, 8.3333333e-3f, -1.6666667e-1f
+  };
+
+  __attribute__((target("avx2,fma"))) inline __m256 acos8(const __m256 x)
+  {
+    __m256 p = _mm256_set1_ps(ACOS_COEFFICIENTS[0]);
+    for (size_t k = 1; k < 8; k++)
+      p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(ACOS_COEFFICIENTS[k]));
+    return _mm256_mul_ps(p, _mm256_sqrt_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), x)));
+  }
+
+  __attribute__((target("avx2,fma"))) inline __m256 sin8(const __m256 x)
+  {
+    // x - k * pi is in [-pi/2, pi/2], odd k flip the sign
+    const __m256 k = _mm256_round_ps(
+      _mm256_mul_ps(x, _mm256_set1_ps(static_cast<float>(M_1_PI))), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(k, _mm256_set1_ps(3.14159274f), x);
+    r = _mm256_fnmadd_ps(k, _mm256_set1_ps(-8.74227766e-8f), r);
+    const __m256 sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtps_epi32(k), 31));
+
+    const __m256 r2 = _mm256_mul_ps(r, r);
+    __m256 p = _mm256_set1_ps(SIN_COEFFICIENTS[0]);
+    for (size_t c = 1; c < 5; c++)
+      p = _mm256_fmadd_ps(p, r2, _mm256_set1_ps(SIN_COEFFICIENTS[c]));
+    return _mm256_xor_ps(_mm256_fmadd_ps(_mm256_mul_ps(p, r2), r, r), sign);
+  }
+
+  // lanes of the legs still solved, all of them without the flags
+  __attribute__((target("avx2,fma"))) inline __m256 active8(const uint8_t *active, const size_t l)
+  {
+    if (!active)
+      return _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    const __m128i flags = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(active + l));
+    return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(flags), _mm256_setzero_si256()));
+  }
+
+  __attribute__((target("avx2,fma"))) inline __m256 dot8(
+    const __m256 ax, const __m256 ay, const __m256 az, const __m256 bx, const __m256 by, const __m256 bz)
+  {
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+  }
+
+  // the same order of the sums as glm, the solver branches on thresholds of the quaternion dot products
+  __attribute__((target("avx2,fma"))) inline __m256 quat_dot8(
+    const __m256 aw,
+    const __m256 ax,
+    const __m256 ay,
+    const __m256 az,
+    const __m256 bw,
+    const __m256 bx,
+    const __m256 by,
+    const __m256 bz)
+  {
+    return _mm256_add_ps(
+      _mm256_add_ps(_mm256_mul_ps(aw, bw), _mm256_mul_ps(ax, bx)),
+      _mm256_add_ps(_mm256_mul_ps(ay, by), _mm256_mul_ps(az, bz)));
+  }
+
+  struct Vec8
+  {
+    __m256 x, y, z;
+  };
+
+  struct Quat8
+  {
+    __m256 w, x, y, z;
+  };
+
+  // rotation_between_vectors(LEG_FORWARD, direction)
+  __attribute__((target("avx2,fma"))) inline Quat8 between8(const Vec8 &direction, const glm::quat &half_turn)
+  {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 inverse = _mm256_div_ps(
+      one, _mm256_sqrt_ps(dot8(direction.x, direction.y, direction.z, direction.x, direction.y, direction.z)));
+    const __m256 cos_theta = _mm256_mul_ps(direction.x, inverse);
+    const __m256 s = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_add_ps(one, cos_theta), _mm256_set1_ps(2.0f)));
+    const __m256 inverse_s = _mm256_div_ps(one, s);
+    const __m256 opposite = _mm256_cmp_ps(cos_theta, _mm256_set1_ps(-1.0f + 0.001f), _CMP_LT_OQ);
+    return Quat8 {
+      _mm256_blendv_ps(_mm256_mul_ps(s, _mm256_set1_ps(0.5f)), _mm256_set1_ps(half_turn.w), opposite),
+      _mm256_blendv_ps(_mm256_setzero_ps(), _mm256_set1_ps(half_turn.x), opposite),
+      _mm256_blendv_ps(
+        _mm256_mul_ps(_mm256_xor_ps(_mm256_mul_ps(direction.z, inverse), _mm256_set1_ps(-0.0f)), inverse_s),
+        _mm256_set1_ps(half_turn.y),
+        opposite),
+      _mm256_blendv_ps(
+        _mm256_mul_ps(_mm256_mul_ps(direction.y, inverse), inverse_s), _mm256_set1_ps(half_turn.z), opposite)
+    };
+  }
+
+  // rotation * LEG_FORWARD
+  __attribute__((target("avx2,fma"))) inline Vec8 forward8(const Quat8 &q)
+  {
+    const __m256 two = _mm256_set1_ps(2.0f);
+    return Vec8 { _mm256_fnmadd_ps(two, _mm256_fmadd_ps(q.y, q.y, _mm256_mul_ps(q.z, q.z)), _mm256_set1_ps(1.0f)),
+                  _mm256_mul_ps(two, _mm256_fmadd_ps(q.x, q.y, _mm256_mul_ps(q.z, q.w))),
+                  _mm256_mul_ps(two, _mm256_fmsub_ps(q.x, q.z, _mm256_mul_ps(q.y, q.w))) };
+  }
+
+  __attribute__((target("avx2,fma"))) inline Vec8 load_position8(const LegChains::Part &part, const size_t l)
+  {
+    return Vec8 { _mm256_loadu_ps(part.x.data() + l),
+                  _mm256_loadu_ps(part.y.data() + l),
+                  _mm256_loadu_ps(part.z.data() + l) };
+  }
+
+  __attribute__((target("avx2,fma"))) inline Quat8 load_rotation8(const LegChains::Part &part, const size_t l)
+  {
+    return Quat8 { _mm256_loadu_ps(part.qw.data() + l),
+                   _mm256_loadu_ps(part.qx.data() + l),
+                   _mm256_loadu_ps(part.qy.data() + l),
+                   _mm256_loadu_ps(part.qz.data() + l) };
+  }
+
+  __attribute__((target("avx2,fma"))) inline void store_masked8(float *data, const __m256 value, const __m256 mask)
+  {
+    _mm256_storeu_ps(data, _mm256_blendv_ps(_mm256_loadu_ps(data), value, mask));
+  }
+
+  // stores the lanes of the mask only
+  __attribute__((target("avx2,fma"))) inline void store_part8(
+    LegChains::Part &part, const size_t l, const Vec8 &position, const Quat8 &rotation, const __m256 mask)
+  {
+    store_masked8(part.x.data() + l, position.x, mask);
+    store_masked8(part.y.data() + l, position.y, mask);
+    store_masked8(part.z.data() + l, position.z, mask);
+    store_masked8(part.qw.data() + l, rotation.w, mask);
+    store_masked8(part.qx.data() + l, rotation.x, mask);
+    store_masked8(part.qy.data() + l, rotation.y, mask);
+    store_masked8(part.qz.data() + l, rotation.z, mask);
+  }
+
+  __attribute__((target("avx2,fma"))) void reach_legs_avx2(
+    LegChains::Part &part,
+    const Goals &goals,
+    const uint8_t *active,
+    const size_t n,
+    const bool place_at_goal,
+    const float max_angle,
+    std::vector<size_t> &moved)
+  {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sign_bit = _mm256_set1_ps(-0.0f);
+    const __m256 angle = _mm256_set1_ps(max_angle);
+    const __m256 inverse_sin_angle = _mm256_set1_ps(1.0f / std::sin(max_angle));
+    // the turn rotation_between_vectors makes between opposite vectors
+    const glm::quat half_turn = glm::angleAxis(static_cast<float>(M_PI), glm::vec3 { 0.0f, 1.0f, 0.0f });
+
+    size_t l = 0;
+    for (; l + 8 <= n; l += 8)
+    {
+      const __m256 solved = active8(active, l);
+      if (_mm256_movemask_ps(solved) == 0)
+        continue;
+
+      const __m256 gx = _mm256_loadu_ps(goals.x + l);
+      const __m256 gy = _mm256_loadu_ps(goals.y + l);
+      const __m256 gz = _mm256_loadu_ps(goals.z + l);
+      const __m256 px = _mm256_loadu_ps(part.x.data() + l);
+      const __m256 py = _mm256_loadu_ps(part.y.data() + l);
+      const __m256 pz = _mm256_loadu_ps(part.z.data() + l);
+
+      // direction to the goal with the locked axes removed
+      __m256 dx = _mm256_sub_ps(gx, px);
+      __m256 dy = _mm256_sub_ps(gy, py);
+      __m256 dz = _mm256_sub_ps(gz, pz);
+      const __m256 distance = _mm256_sqrt_ps(dot8(dx, dy, dz, dx, dy, dz));
+      const __m256 far = _mm256_cmp_ps(distance, _mm256_set1_ps(1e-2f), _CMP_GT_OQ);
+      __m256 inverse = _mm256_div_ps(one, distance);
+      dx = _mm256_mul_ps(_mm256_mul_ps(dx, inverse), _mm256_loadu_ps(part.sx.data() + l));
+      dy = _mm256_mul_ps(_mm256_mul_ps(dy, inverse), _mm256_loadu_ps(part.sy.data() + l));
+      dz = _mm256_mul_ps(_mm256_mul_ps(dz, inverse), _mm256_loadu_ps(part.sz.data() + l));
+      inverse = _mm256_div_ps(one, _mm256_sqrt_ps(dot8(dx, dy, dz, dx, dy, dz)));
+      dx = _mm256_mul_ps(dx, inverse);
+      dy = _mm256_mul_ps(dy, inverse);
+      dz = _mm256_mul_ps(dz, inverse);
+      const __m256 reach = _mm256_and_ps(_mm256_and_ps(far, solved), _mm256_cmp_ps(dx, dx, _CMP_ORD_Q));
+      const int reach_mask = _mm256_movemask_ps(reach);
+      if (reach_mask == 0)
+        continue;
+
+      const auto [bw, bx, by, bz] = between8(Vec8 { dx, dy, dz }, half_turn);
+
+      // rotate_lookat(rotation, between, max_angle)
+      const __m256 qw = _mm256_loadu_ps(part.qw.data() + l);
+      const __m256 qx = _mm256_loadu_ps(part.qx.data() + l);
+      const __m256 qy = _mm256_loadu_ps(part.qy.data() + l);
+      const __m256 qz = _mm256_loadu_ps(part.qz.data() + l);
+      __m256 rw = qw, rx = qx, ry = qy, rz = qz;
+      if (max_angle >= 0.0001f)
+      {
+        __m256 cos_q = quat_dot8(qw, qx, qy, qz, bw, bx, by, bz);
+        const __m256 flip = _mm256_and_ps(cos_q, sign_bit);
+        cos_q = _mm256_xor_ps(cos_q, flip);
+        const __m256 aw = _mm256_xor_ps(qw, flip);
+        const __m256 ax = _mm256_xor_ps(qx, flip);
+        const __m256 ay = _mm256_xor_ps(qy, flip);
+        const __m256 az = _mm256_xor_ps(qz, flip);
+        const __m256 q_angle = acos8(_mm256_min_ps(cos_q, one));
+        const __m256 close = _mm256_or_ps(
+          _mm256_cmp_ps(cos_q, _mm256_set1_ps(0.9999f), _CMP_GT_OQ),
+          _mm256_cmp_ps(q_angle, _mm256_max_ps(angle, _mm256_set1_ps(1e-4f)), _CMP_LT_OQ));
+
+        const __m256 t = _mm256_div_ps(angle, q_angle);
+        const __m256 k1 = _mm256_mul_ps(sin8(_mm256_mul_ps(_mm256_sub_ps(one, t), angle)), inverse_sin_angle);
+        const __m256 k2 = _mm256_mul_ps(sin8(_mm256_mul_ps(t, angle)), inverse_sin_angle);
+        const __m256 sw = _mm256_fmadd_ps(k1, aw, _mm256_mul_ps(k2, bw));
+        const __m256 sx = _mm256_fmadd_ps(k1, ax, _mm256_mul_ps(k2, bx));
+        const __m256 sy = _mm256_fmadd_ps(k1, ay, _mm256_mul_ps(k2, by));
+        const __m256 sz = _mm256_fmadd_ps(k1, az, _mm256_mul_ps(k2, bz));
+        const __m256 inverse_length = _mm256_div_ps(one, _mm256_sqrt_ps(quat_dot8(sw, sx, sy, sz, sw, sx, sy, sz)));
+        rw = _mm256_blendv_ps(_mm256_mul_ps(sw, inverse_length), bw, close);
+        rx = _mm256_blendv_ps(_mm256_mul_ps(sx, inverse_length), bx, close);
+        ry = _mm256_blendv_ps(_mm256_mul_ps(sy, inverse_length), by, close);
+        rz = _mm256_blendv_ps(_mm256_mul_ps(sz, inverse_length), bz, close);
+      }
+      _mm256_storeu_ps(part.qw.data() + l, _mm256_blendv_ps(qw, rw, reach));
+      _mm256_storeu_ps(part.qx.data() + l, _mm256_blendv_ps(qx, rx, reach));
+      _mm256_storeu_ps(part.qy.data() + l, _mm256_blendv_ps(qy, ry, reach));
+      _mm256_storeu_ps(part.qz.data() + l, _mm256_blendv_ps(qz, rz, reach));
+
+      // the foot stands on the goal, the other parts end at it
+      const __m256 offset = place_at_goal ? zero : _mm256_loadu_ps(part.length.data() + l);
+      _mm256_storeu_ps(part.x.data() + l, _mm256_blendv_ps(px, _mm256_fnmadd_ps(dx, offset, gx), reach));
+      _mm256_storeu_ps(part.y.data() + l, _mm256_blendv_ps(py, _mm256_fnmadd_ps(dy, offset, gy), reach));
+      _mm256_storeu_ps(part.z.data() + l, _mm256_blendv_ps(pz, _mm256_fnmadd_ps(dz, offset, gz), reach));
+
+      for (int k = 0; k < 8; k++)
+        if (reach_mask & (1 << k))
+          moved.push_back(l + k);
+    }
+
+    reach_legs_scalar(part, goals, active, l, n, place_at_goal, max_angle, moved);
+  }
+
+  __attribute__((target("avx2,fma"))) void chain_legs_avx2(
+    LegChains &legs, const glm::vec3 &root, const uint8_t *active, const size_t n)
+  {
+    size_t l = 0;
+    for (; l + 8 <= n; l += 8)
+    {
+      // converged legs get the same positions again, only blocks without any active leg are skipped
+      if (_mm256_movemask_ps(active8(active, l)) == 0)
+        continue;
+
+      __m256 x = _mm256_set1_ps(root.x);
+      __m256 y = _mm256_set1_ps(root.y);
+      __m256 z = _mm256_set1_ps(root.z);
+      for (LegChains::Part &part : legs.parts)
+      {
+        _mm256_storeu_ps(part.x.data() + l, x);
+        _mm256_storeu_ps(part.y.data() + l, y);
+        _mm256_storeu_ps(part.z.data() + l, z);
+
+        const Vec8 forward = forward8(load_rotation8(part, l));
+        const __m256 length = _mm256_loadu_ps(part.length.data() + l);
+        x = _mm256_fmadd_ps(forward.x, length, x);
+        y = _mm256_fmadd_ps(forward.y, length, y);
+        z = _mm256_fmadd_ps(forward.z, length, z);
+      }
+    }
+
+    chain_legs_scalar(legs, root, active, l, n);
+  }
+
+  // get_fabrik_direction of the lanes, from the point to the goal
+  __attribute__((target("avx2,fma"))) inline Vec8 fabrik_direction8(
+    const LegChains::Part &part, const size_t l, const Vec8 &point, const Vec8 &goal, const Quat8 &rotation)
+  {
+    const Vec8 offset { _mm256_mul_ps(_mm256_sub_ps(goal.x, point.x), _mm256_loadu_ps(part.sx.data() + l)),
+                        _mm256_mul_ps(_mm256_sub_ps(goal.y, point.y), _mm256_loadu_ps(part.sy.data() + l)),
+                        _mm256_mul_ps(_mm256_sub_ps(goal.z, point.z), _mm256_loadu_ps(part.sz.data() + l)) };
+    const __m256 length = _mm256_sqrt_ps(dot8(offset.x, offset.y, offset.z, offset.x, offset.y, offset.z));
+    const __m256 valid = _mm256_and_ps(
+      _mm256_cmp_ps(length, _mm256_set1_ps(1e-6f), _CMP_GT_OQ),
+      _mm256_cmp_ps(length, _mm256_set1_ps(INFINITY), _CMP_LT_OQ));
+    const Vec8 current = forward8(rotation);
+    return Vec8 { _mm256_blendv_ps(current.x, _mm256_div_ps(offset.x, length), valid),
+                  _mm256_blendv_ps(current.y, _mm256_div_ps(offset.y, length), valid),
+                  _mm256_blendv_ps(current.z, _mm256_div_ps(offset.z, length), valid) };
+  }
+
+  __attribute__((target("avx2,fma"))) void fabrik_backward_avx2(
+    LegChains::Part &part,
+    const Goals &goals,
+    const uint8_t *active,
+    const size_t n,
+    const bool place_at_goal,
+    std::vector<size_t> &moved)
+  {
+    const glm::quat half_turn = glm::angleAxis(static_cast<float>(M_PI), glm::vec3 { 0.0f, 1.0f, 0.0f });
+
+    size_t l = 0;
+    for (; l + 8 <= n; l += 8)
+    {
+      const __m256 solved = active8(active, l);
+      const int solved_mask = _mm256_movemask_ps(solved);
+      if (solved_mask == 0)
+        continue;
+
+      const Vec8 goal { _mm256_loadu_ps(goals.x + l), _mm256_loadu_ps(goals.y + l), _mm256_loadu_ps(goals.z + l) };
+      const Vec8 dir = fabrik_direction8(part, l, load_position8(part, l), goal, load_rotation8(part, l));
+      const Quat8 rotation = between8(dir, half_turn);
+      const Vec8 forward = forward8(rotation);
+      const __m256 length = place_at_goal ? _mm256_setzero_ps() : _mm256_loadu_ps(part.length.data() + l);
+      const Vec8 position { _mm256_fnmadd_ps(forward.x, length, goal.x),
+                            _mm256_fnmadd_ps(forward.y, length, goal.y),
+                            _mm256_fnmadd_ps(forward.z, length, goal.z) };
+      store_part8(part, l, position, rotation, solved);
+
+      for (int k = 0; k < 8; k++)
+        if (solved_mask & (1 << k))
+          moved.push_back(l + k);
+    }
+
+    fabrik_backward_scalar(part, goals, active, l, n, place_at_goal, moved);
+  }
+
+  __attribute__((target("avx2,fma"))) void fabrik_forward_avx2(
+    LegChains &legs, const glm::vec3 &root, const uint8_t *active, const size_t n)
+  {
+    const glm::quat half_turn = glm::angleAxis(static_cast<float>(M_PI), glm::vec3 { 0.0f, 1.0f, 0.0f });
+
+    size_t l = 0;
+    for (; l + 8 <= n; l += 8)
+    {
+      const __m256 solved = active8(active, l);
+      if (_mm256_movemask_ps(solved) == 0)
+        continue;
+
+      Vec8 begin { _mm256_set1_ps(root.x), _mm256_set1_ps(root.y), _mm256_set1_ps(root.z) };
+      for (size_t p = 0; p + 1 < LEG_PARTS; p++)
+      {
+        LegChains::Part &part = legs.parts[p];
+        const Vec8 end = load_position8(legs.parts[p + 1], l);
+        const Vec8 dir = fabrik_direction8(part, l, begin, end, load_rotation8(part, l));
+        const Quat8 rotation = between8(dir, half_turn);
+        store_part8(part, l, begin, rotation, solved);
+
+        const Vec8 forward = forward8(rotation);
+        const __m256 length = _mm256_loadu_ps(part.length.data() + l);
+        begin = Vec8 { _mm256_fmadd_ps(forward.x, length, begin.x),
+                       _mm256_fmadd_ps(forward.y, length, begin.y),
+                       _mm256_fmadd_ps(forward.z, length, begin.z) };
+      }
+      LegChains::Part &foot = legs.parts[LEG_PARTS - 1];
+      store_part8(foot, l, begin, load_rotation8(foot, l), solved);
+    }
+
+    fabrik_forward_scalar(legs, root, active, l, n);
+  }
+
+  __attribute__((target("sse4.1"))) inline __m128 acos4(const __m128 x)
+  {
+    __m128 p = _mm_set1_ps(ACOS_COEFFICIENTS[0]);
+    for (size_t k = 1; k < 8; k++)
+      p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(ACOS_COEFFICIENTS[k]));
+    return _mm_mul_ps(p, _mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), x)));
+  }
+
+  __attribute__((target("sse4.1"))) inline __m128 sin4(const __m128 x)
+  {
+    const __m128 k = _mm_round_ps(
+      _mm_mul_ps(x, _mm_set1_ps(static_cast<float>(M_1_PI))), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(k, _mm_set1_ps(3.14159274f)));
+    r = _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(-8.74227766e-8f)));
+    const __m128 sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_cvtps_epi32(k), 31));
+
+    const __m128 r2 = _mm_mul_ps(r, r);
+    __m128 p = _mm_set1_ps(SIN_COEFFICIENTS[0]);
+    for (size_t c = 1; c < 5; c++)
+      p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(SIN_COEFFICIENTS[c]));
+    return _mm_xor_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, r2), r), r), sign);
+  }
+
+  __attribute__((target("sse4.1"))) inline __m128 active4(const uint8_t *active, const size_t l)
+  {
+    if (!active)
+      return _mm_castsi128_ps(_mm_set1_epi32(-1));
+    int32_t flags;
+    std::memcpy(&flags, active + l, sizeof(flags));
+    return _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(flags)), _mm_setzero_si128()));
+  }
+
+  __attribute__((target("sse4.1"))) inline __m128 dot4(
+    const __m128 ax, const __m128 ay, const __m128 az, const __m128 bx, const __m128 by, const __m128 bz)
+  {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+  }
+
+  __attribute__((target("sse4.1"))) inline __m128 quat_dot4(
+    const __m128 aw,
+    const __m128 ax,
+    const __m128 ay,
+    const __m128 az,
+    const __m128 bw,
+    const __m128 bx,
+    const __m128 by,
+    const __m128 bz)
+  {
+    return _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(aw, bw), _mm_mul_ps(ax, bx)), _mm_add_ps(_mm_mul_ps(ay, by), _mm_mul_ps(az, bz)));
+  }
+
+  __attribute__((target("sse4.1"))) void reach_legs_sse41(
+    LegChains::Part &part,
+    const Goals &goals,
+    const uint8_t *active,
+    const size_t n,
+    const bool place_at_goal,
+    const float max_angle,
+    std::vector<size_t> &moved)
+  {
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign_bit = _mm_set1_ps(-0.0f);
+    const __m128 angle = _mm_set1_ps(max_angle);
+    const __m128 inverse_sin_angle = _mm_set1_ps(1.0f / std::sin(max_angle));
+    const glm::quat half_turn = glm::angleAxis(static_cast<float>(M_PI), glm::vec3 { 0.0f, 1.0f, 0.0f });
+
+    size_t l = 0;
+    for (; l + 4 <= n; l += 4)
+    {
+      const __m128 solved = active4(active, l);
+      if (_mm_movemask_ps(solved) == 0)
+        continue;
+
+      const __m128 gx = _mm_loadu_ps(goals.x + l);
+      const __m128 gy = _mm_loadu_ps(goals.y + l);
+      const __m128 gz = _mm_loadu_ps(goals.z + l);
+      const __m128 px = _mm_loadu_ps(part.x.data() + l);
+      const __m128 py = _mm_loadu_ps(part.y.data() + l);
+      const __m128 pz = _mm_loadu_ps(part.z.data() + l);
+
+      __m128 dx = _mm_sub_ps(gx, px);
+      __m128 dy = _mm_sub_ps(gy, py);
+      __m128 dz = _mm_sub_ps(gz, pz);
+      const __m128 distance = _mm_sqrt_ps(dot4(dx, dy, dz, dx, dy, dz));
+      const __m128 far = _mm_cmpgt_ps(distance, _mm_set1_ps(1e-2f));
+      __m128 inverse = _mm_div_ps(one, distance);
+      dx = _mm_mul_ps(_mm_mul_ps(dx, inverse), _mm_loadu_ps(part.sx.data() + l));
+      dy = _mm_mul_ps(_mm_mul_ps(dy, inverse), _mm_loadu_ps(part.sy.data() + l));
+      dz = _mm_mul_ps(_mm_mul_ps(dz, inverse), _mm_loadu_ps(part.sz.data() + l));
+      inverse = _mm_div_ps(one, _mm_sqrt_ps(dot4(dx, dy, dz, dx, dy, dz)));
+      dx = _mm_mul_ps(dx, inverse);
+      dy = _mm_mul_ps(dy, inverse);
+      dz = _mm_mul_ps(dz, inverse);
+      const __m128 reach = _mm_and_ps(_mm_and_ps(far, solved), _mm_cmpord_ps(dx, dx));
+      const int reach_mask = _mm_movemask_ps(reach);
+      if (reach_mask == 0)
+        continue;
+
+      inverse = _mm_div_ps(one, _mm_sqrt_ps(dot4(dx, dy, dz, dx, dy, dz)));
+      const __m128 cos_theta = _mm_mul_ps(dx, inverse);
+      const __m128 s = _mm_sqrt_ps(_mm_mul_ps(_mm_add_ps(one, cos_theta), _mm_set1_ps(2.0f)));
+      const __m128 inverse_s = _mm_div_ps(one, s);
+      const __m128 opposite = _mm_cmplt_ps(cos_theta, _mm_set1_ps(-1.0f + 0.001f));
+      const __m128 bw = _mm_blendv_ps(_mm_mul_ps(s, _mm_set1_ps(0.5f)), _mm_set1_ps(half_turn.w), opposite);
+      const __m128 bx = _mm_blendv_ps(zero, _mm_set1_ps(half_turn.x), opposite);
+      const __m128 by = _mm_blendv_ps(
+        _mm_mul_ps(_mm_xor_ps(_mm_mul_ps(dz, inverse), sign_bit), inverse_s), _mm_set1_ps(half_turn.y), opposite);
+      const __m128 bz =
+        _mm_blendv_ps(_mm_mul_ps(_mm_mul_ps(dy, inverse), inverse_s), _mm_set1_ps(half_turn.z), opposite);
+
+      const __m128 qw = _mm_loadu_ps(part.qw.data() + l);
+      const __m128 qx = _mm_loadu_ps(part.qx.data() + l);
+      const __m128 qy = _mm_loadu_ps(part.qy.data() + l);
+      const __m128 qz = _mm_loadu_ps(part.qz.data() + l);
+      __m128 rw = qw, rx = qx, ry = qy, rz = qz;
+      if (max_angle >= 0.0001f)
+      {
+        __m128 cos_q = quat_dot4(qw, qx, qy, qz, bw, bx, by, bz);
+        const __m128 flip = _mm_and_ps(cos_q, sign_bit);
+        cos_q = _mm_xor_ps(cos_q, flip);
+        const __m128 aw = _mm_xor_ps(qw, flip);
+        const __m128 ax = _mm_xor_ps(qx, flip);
+        const __m128 ay = _mm_xor_ps(qy, flip);
+        const __m128 az = _mm_xor_ps(qz, flip);
+        const __m128 q_angle = acos4(_mm_min_ps(cos_q, one));
+        const __m128 close = _mm_or_ps(
+          _mm_cmpgt_ps(cos_q, _mm_set1_ps(0.9999f)), _mm_cmplt_ps(q_angle, _mm_max_ps(angle, _mm_set1_ps(1e-4f))));
+
+        const __m128 t = _mm_div_ps(angle, q_angle);
+        const __m128 k1 = _mm_mul_ps(sin4(_mm_mul_ps(_mm_sub_ps(one, t), angle)), inverse_sin_angle);
+        const __m128 k2 = _mm_mul_ps(sin4(_mm_mul_ps(t, angle)), inverse_sin_angle);
+        const __m128 sw = _mm_add_ps(_mm_mul_ps(k1, aw), _mm_mul_ps(k2, bw));
+        const __m128 sx = _mm_add_ps(_mm_mul_ps(k1, ax), _mm_mul_ps(k2, bx));
+        const __m128 sy = _mm_add_ps(_mm_mul_ps(k1, ay), _mm_mul_ps(k2, by));
+        const __m128 sz = _mm_add_ps(_mm_mul_ps(k1, az), _mm_mul_ps(k2, bz));
+        const __m128 inverse_length = _mm_div_ps(one, _mm_sqrt_ps(quat_dot4(sw, sx, sy, sz, sw, sx, sy, sz)));
+        rw = _mm_blendv_ps(_mm_mul_ps(sw, inverse_length), bw, close);
+        rx = _mm_blendv_ps(_mm_mul_ps(sx, inverse_length), bx, close);
+        ry = _mm_blendv_ps(_mm_mul_ps(sy, inverse_length), by, close);
+        rz = _mm_blendv_ps(_mm_mul_ps(sz, inverse_length), bz, close);
+      }
+      _mm_storeu_ps(part.qw.data() + l, _mm_blendv_ps(qw, rw, reach));
+      _mm_storeu_ps(part.qx.data() + l, _mm_blendv_ps(qx, rx, reach));
+      _mm_storeu_ps(part.qy.data() + l, _mm_blendv_ps(qy, ry, reach));
+      _mm_storeu_ps(part.qz.data() + l, _mm_blendv_ps(qz, rz, reach));
+
+      const __m128 offset = place_at_goal ? zero : _mm_loadu_ps(part.length.data() + l);
+      _mm_storeu_ps(part.x.data() + l, _mm_blendv_ps(px, _mm_sub_ps(gx, _mm_mul_ps(dx, offset)), reach));
+      _mm_storeu_ps(part.y.data() + l, _mm_blendv_ps(py, _mm_sub_ps(gy, _mm_mul_ps(dy, offset)), reach));
+      _mm_storeu_ps(part.z.data() + l, _mm_blendv_ps(pz, _mm_sub_ps(gz, _mm_mul_ps(dz, offset)), reach));
+
+      for (int k = 0; k < 4; k++)
+        if (reach_mask & (1 << k))
+          moved.push_back(l + k);
+    }
+
+    reach_legs_scalar(part, goals, active, l, n, place_at_goal, max_angle, moved);
+  }
+
+  __attribute__((target("sse4.1"))) void chain_legs_sse41(
+    LegChains &legs, const glm::vec3 &root, const uint8_t *active, const size_t n)
+  {
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+
+    size_t l = 0;
+    for (; l + 4 <= n; l += 4)
+    {
+      if (_mm_movemask_ps(active4(active, l)) == 0)
+        continue;
+
+      __m128 x = _mm_set1_ps(root.x);
+      __m128 y = _mm_set1_ps(root.y);
+      __m128 z = _mm_set1_ps(root.z);
+      for (LegChains::Part &part : legs.parts)
+      {
+        _mm_storeu_ps(part.x.data() + l, x);
+        _mm_storeu_ps(part.y.data() + l, y);
+        _mm_storeu_ps(part.z.data() + l, z);
+
+        const __m128 qw = _mm_loadu_ps(part.qw.data() + l);
+        const __m128 qx = _mm_loadu_ps(part.qx.data() + l);
+        const __m128 qy = _mm_loadu_ps(part.qy.data() + l);
+        const __m128 qz = _mm_loadu_ps(part.qz.data() + l);
+        const __m128 length = _mm_loadu_ps(part.length.data() + l);
+        const __m128 fx = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(qy, qy), _mm_mul_ps(qz, qz))));
+        const __m128 fy = _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(qx, qy), _mm_mul_ps(qz, qw)));
+        const __m128 fz = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qx, qz), _mm_mul_ps(qy, qw)));
+        x = _mm_add_ps(x, _mm_mul_ps(fx, length));
+        y = _mm_add_ps(y, _mm_mul_ps(fy, length));
+        z = _mm_add_ps(z, _mm_mul_ps(fz, length));
+      }
+    }
+
+    chain_legs_scalar(legs, root, active, l, n);
+  }
+
+#endif
+} // namespace
+
+void reach_leg_goals(
+  LegChains::Part &part,
+  std::span<const float> goal_x,
+  std::span<const float> goal_y,
+  std::span<const float> goal_z,
+  const bool place_at_goal,
+  const float max_angle,
+  std::span<const uint8_t> active,
+  std::vector<size_t> &moved,
+  const NoiseKernel kernel)
+{
+  const size_t n = std::min({ part.x.size(), goal_x.size(), goal_y.size(), goal_z.size() });
+  const Goals goals { goal_x.data(), goal_y.data(), goal_z.data() };
+  const uint8_t *flags = active.size() >= n ? active.data() : nullptr;
+
+  switch (kernel)
+  {
+#ifdef LEG_SOLVER_X86
+    case NoiseKernel::AVX2: reach_legs_avx2(part, goals, flags, n, place_at_goal, max_angle, moved); break;
+    case NoiseKernel::SSE41: reach_legs_sse41(part, goals, flags, n, place_at_goal, max_angle, moved); break;
+#endif
+    case NoiseKernel::Scalar:
+    default: reach_legs_scalar(part, goals, flags, 0, n, place_at_goal, max_angle, moved); break;
+  }
+}
+
+void fabrik_backward(
+  LegChains::Part &part,
+  std::span<const float> goal_x,
+  std::span<const float> goal_y,
+  std::span<const float> goal_z,
+  const bool place_at_goal,
+  std::span<const uint8_t> active,
+  std::vector<size_t> &moved,
+  const NoiseKernel kernel)
+{
+  const size_t n = std::min({ part.x.size(), goal_x.size(), goal_y.size(), goal_z.size() });
+  const Goals goals { goal_x.data(), goal_y.data(), goal_z.data() };
+  const uint8_t *flags = active.size() >= n ? active.data() : nullptr;
+
+  // there is no SSE4.1 variant, it falls back to the scalar kernel
+  switch (kernel)
+  {
+#ifdef LEG_SOLVER_X86
+    case NoiseKernel::AVX2: fabrik_backward_avx2(part, goals, flags, n, place_at_goal, moved); break;
+#endif
+    case NoiseKernel::SSE41:
+    case NoiseKernel::Scalar:
+    default: fabrik_backward_scalar(part, goals, flags, 0, n, place_at_goal, moved); break;
+  }
+}
+
+void fabrik_forward(LegChains &legs, const glm::vec3 &root, std::span<const uint8_t> active, const NoiseKernel kernel)
+{
+  const size_t n = legs.size();
+  const uint8_t *flags = active.size() >= n ? active.data() : nullptr;
+
+  switch (kernel)
+  {
+#ifdef LEG_SOLVER_X86
+    case NoiseKernel::AVX2: fabrik_forward_avx2(legs, root, flags, n); break;
+#endif
+    case NoiseKernel::SSE41:
+    case NoiseKernel::Scalar:
+    default: fabrik_forward_scalar(legs, root, flags, 0, n); break;
+  }
+}
+
+void chain_leg_parts(
+  LegChains &legs, const glm::vec3 &root, std::span<const uint8_t> active, const NoiseKernel kernel)
+{
+  const size_t n = legs.size();
+  const uint8_t *flags = active.size() >= n ? active.data() : nullptr;
+
+  switch (kernel)
+  {
+#ifdef LEG_SOLVER_X86
+    case NoiseKernel::AVX2: chain_legs_avx2(legs, root, flags, n); break;
+    case NoiseKernel::SSE41: chain_legs_sse41(legs, root, flags, n); break;
+#endif
+    case NoiseKernel::Scalar:
+    default: chain_legs_scalar(legs, root, flags, 0, n); break;
+  }
+}
+
+void LegConvergence::reset(const LegChains &legs)
+{
+  const size_t n = legs.size();
+  active.assign(n, 1);
+  active_count = n;
+  rotations.resize(n);
+  feet.resize(n);
+  for (size_t l = 0; l < n; l++)
+  {
+    for (size_t p = 0; p < LEG_PARTS; p++)
+      rotations[l][p] = legs.parts[p].get_rotation(l);
+    feet[l] = legs.parts[LEG_PARTS - 1].get_end(l);
+  }
+}
+
+size_t LegConvergence::update(const LegChains &legs, const float position_tolerance, const float rotation_tolerance)
+{
+  // the distance between unit quaternions is about half of the angle between their rotations
+  const float chord_tolerance = rotation_tolerance * 0.5f;
+  for (size_t l = 0; l < active.size(); l++)
+  {
+    if (!active[l])
+      continue;
+
+    bool converged = true;
+    for (size_t p = 0; p < LEG_PARTS; p++)
+    {
+      const glm::quat q = legs.parts[p].get_rotation(l);
+      glm::quat &previous = rotations[l][p];
+      const float sign = glm::dot(q, previous) < 0.0f ? -1.0f : 1.0f;
+      const glm::vec4 delta {
+        q.x - previous.x * sign, q.y - previous.y * sign, q.z - previous.z * sign, q.w - previous.w * sign
+      };
+      converged = converged && glm::dot(delta, delta) <= chord_tolerance * chord_tolerance;
+      previous = q;
+    }
+
+    const glm::vec3 foot = legs.parts[LEG_PARTS - 1].get_end(l);
+    converged = converged && glm::distance(foot, feet[l]) <= position_tolerance;
+    feet[l] = foot;
+
+    if (converged)
+    {
+      active[l] = 0;
+      active_count--;
+    }
+  }
+  return active_count;
+}
+
+std::vector<LegSolverBenchmark> leg_solver_benchmark(const size_t legs_count, const size_t iterations)
+{
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> random(-1.0f, 1.0f);
+
+  // feet targets around the root in reach, every fourth leg has a locked axis
+  LegChains initial;
+  initial.resize(legs_count);
+  for (size_t l = 0; l < legs_count; l++)
+  {
+    initial.set_target(l, { random(generator) * 3.0f, random(generator) * 2.0f - 1.0f, random(generator) * 3.0f });
+    for (LegChains::Part &part : initial.parts)
+    {
+      part.set_rotation(
+        l,
+        glm::normalize(glm::quat { random(generator), random(generator), random(generator), random(generator) }));
+      if (l % 4 == 3)
+        part.sy[l] = 0.0f;
+    }
+  }
+  chain_leg_parts(initial, glm::vec3 { 0.0f }, {}, NoiseKernel::Scalar);
+
+  std::vector<NoiseKernel> kernels { NoiseKernel::Scalar };
+  if (noise_kernel() == NoiseKernel::AVX2)
+    kernels.push_back(NoiseKernel::SSE41);
+  if (noise_kernel() != NoiseKernel::Scalar)
+    kernels.push_back(noise_kernel());
+
+  const float max_angle = 0.08f / static_cast<float>(std::max<size_t>(1, iterations));
+  std::vector<size_t> moved;
+  moved.reserve(legs_count);
+  LegChains reference;
+  std::vector<LegSolverBenchmark> results;
+  for (const auto kernel : kernels)
+  {
+    LegChains legs = initial;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+      for (size_t p = LEG_PARTS; p-- > 0;)
+      {
+        const bool foot = p == LEG_PARTS - 1;
+        const auto &goal_x = foot ? legs.target_x : legs.parts[p + 1].x;
+        const auto &goal_y = foot ? legs.target_y : legs.parts[p + 1].y;
+        const auto &goal_z = foot ? legs.target_z : legs.parts[p + 1].z;
+        moved.clear();
+        reach_leg_goals(legs.parts[p], goal_x, goal_y, goal_z, foot, max_angle, {}, moved, kernel);
+      }
+      chain_leg_parts(legs, glm::vec3 { 0.0f }, {}, kernel);
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    if (kernel == NoiseKernel::Scalar)
+      reference = legs;
+
+    float max_error = 0.0f;
+    size_t mismatches = 0;
+    for (size_t l = 0; l < legs_count; l++)
+    {
+      float error = 0.0f;
+      for (size_t p = 0; p < LEG_PARTS; p++)
+        error = std::max(error, glm::distance(legs.parts[p].get_position(l), reference.parts[p].get_position(l)));
+      max_error = std::max(max_error, error);
+      if (error > LEG_SOLVER_TOLERANCE)
+        mismatches++;
+    }
+
+    const double us = std::chrono::duration<double, std::micro>(end - start).count();
+    results.push_back(
+      { kernel, legs_count, us / static_cast<double>(std::max<size_t>(1, legs_count)), max_error, mismatches });
+  }
+
+  return results;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "ZD/3rd/glm/glm.hpp"
+#include "ZD/3rd/glm/gtc/quaternion.hpp"
+
+#include "noise.hpp"
+
+static constexpr std::array LEG_LENGTHS { 1.00f, 1.01f, 1.65f };
+static constexpr size_t LEG_PARTS { LEG_LENGTHS.size() };
+static const glm::vec3 LEG_FORWARD { 1.0f, 0.0f, 0.0f };
+
+// inverse kinematics state of all the legs, every value of a part is kept in its own array indexed by the leg
+// so the solver walks the legs linearly instead of going through the entities
+struct LegChains
+{
+  struct Part
+  {
+    std::vector<float> x, y, z; // beginning of the part
+    std::vector<float> qw, qx, qy, qz; // rotation of LEG_FORWARD
+    std::vector<float> sx, sy, sz; // rotation_scalar, 0 locks the direction along the axis
+    std::vector<float> length;
+
+    inline glm::vec3 get_position(const size_t l) const { return { x[l], y[l], z[l] }; }
+    inline void set_position(const size_t l, const glm::vec3 &p)
+    {
+      x[l] = p.x;
+      y[l] = p.y;
+      z[l] = p.z;
+    }
+    inline glm::quat get_rotation(const size_t l) const { return glm::quat { qw[l], qx[l], qy[l], qz[l] }; }
+    inline void set_rotation(const size_t l, const glm::quat &q)
+    {
+      qw[l] = q.w;
+      qx[l] = q.x;
+      qy[l] = q.y;
+      qz[l] = q.z;
+    }
+    inline glm::vec3 get_rotation_scalar(const size_t l) const { return { sx[l], sy[l], sz[l] }; }
+    inline void set_rotation_scalar(const size_t l, const glm::vec3 &s)
+    {
+      sx[l] = s.x;
+      sy[l] = s.y;
+      sz[l] = s.z;
+    }
+    inline glm::vec3 get_end(const size_t l) const
+    {
+      return get_position(l) + get_rotation(l) * LEG_FORWARD * length[l];
+    }
+  };
+
+  std::array<Part, LEG_PARTS> parts; // from the body to the foot
+  std::vector<float> target_x, target_y, target_z; // where the feet are going
+
+  inline size_t size() const { return target_x.size(); }
+  // new legs start folded at the origin
+  void resize(const size_t n);
+
+  inline glm::vec3 get_target(const size_t l) const { return { target_x[l], target_y[l], target_z[l] }; }
+  inline void set_target(const size_t l, const glm::vec3 &t)
+  {
+    target_x[l] = t.x;
+    target_y[l] = t.y;
+    target_z[l] = t.z;
+  }
+};
+
+// shortest rotation turning start into dest
+glm::quat rotation_between_vectors(glm::vec3 start, glm::vec3 dest);
+// turns q1 toward q2 by at most max_angle
+glm::quat rotate_lookat(glm::quat q1, glm::quat q2, float max_angle);
+
+// the solver runs on the same kernels as the noise, 4 or 8 legs at once when the CPU supports it,
+// a step of a vectorized kernel is equal to the scalar glm solver up to LEG_SOLVER_TOLERANCE,
+// except for the rare legs right at one of the thresholds of rotate_lookat which may fall on the other side
+static constexpr float LEG_SOLVER_TOLERANCE { 1e-4f };
+
+// one inverse kinematics step over a part of all the legs, every part turns toward its goal by up to max_angle,
+// the foot is placed at the goal and the other parts are moved to end at it,
+// parts closer than 1e-2 to the goal or locked in every direction toward it stay in place,
+// only the legs with a nonzero active flag are solved, all of them when there are no flags,
+// the indices of the moved legs are appended in order
+void reach_leg_goals(
+  LegChains::Part &part,
+  std::span<const float> goal_x,
+  std::span<const float> goal_y,
+  std::span<const float> goal_z,
+  const bool place_at_goal,
+  const float max_angle,
+  std::span<const uint8_t> active,
+  std::vector<size_t> &moved,
+  const NoiseKernel kernel = noise_kernel());
+
+// the first part of every leg begins at the root and every next one at the end of the previous one
+void chain_leg_parts(
+  LegChains &legs,
+  const glm::vec3 &root,
+  std::span<const uint8_t> active,
+  const NoiseKernel kernel = noise_kernel());
+
+// how the legs are solved, the ground collisions run between the steps of both
+enum class LegSolverMethod
+{
+  RotateToward, // every iteration turns the parts toward their goals by a limited angle
+  FABRIK, // forward and backward reaching, the parts point straight at their goals
+};
+
+// FABRIK backward step over a part of all the legs, every part points from its beginning at its goal
+// with the locked directions removed the same as in reach_leg_goals, the foot is placed at the goal
+// the same as there and the other parts are moved to end at it,
+// a part locked in every direction toward the goal keeps its direction,
+// the indices of the moved legs are appended in order
+void fabrik_backward(
+  LegChains::Part &part,
+  std::span<const float> goal_x,
+  std::span<const float> goal_y,
+  std::span<const float> goal_z,
+  const bool place_at_goal,
+  std::span<const uint8_t> active,
+  std::vector<size_t> &moved,
+  const NoiseKernel kernel = noise_kernel());
+
+// FABRIK forward step, the first part of every leg begins at the root and every part points from its new beginning
+// at where the next one began before, with the same locks, the foot follows and keeps its direction
+void fabrik_forward(
+  LegChains &legs,
+  const glm::vec3 &root,
+  std::span<const uint8_t> active,
+  const NoiseKernel kernel = noise_kernel());
+
+// legs that barely moved during an iteration of the solver have converged, the next iterations
+// would repeat about the same steps for them so they are left out of the rest of the solve
+class LegConvergence final
+{
+public:
+  // every leg is solved again from its current state
+  void reset(const LegChains &legs);
+  // drops the legs whose feet moved less than the position tolerance and parts turned less than
+  // the rotation tolerance in radians since the previous call, returns how many are still solved
+  size_t update(const LegChains &legs, const float position_tolerance, const float rotation_tolerance);
+
+  inline std::span<const uint8_t> get_active() const { return active; }
+  inline size_t get_active_count() const { return active_count; }
+
+private:
+  std::vector<uint8_t> active;
+  size_t active_count { 0 };
+  // state of the legs at the previous call
+  std::vector<std::array<glm::quat, LEG_PARTS>> rotations;
+  std::vector<glm::vec3> feet;
+};
+
+struct LegSolverBenchmark
+{
+  NoiseKernel kernel;
+  size_t legs_count;
+  double us_per_leg; // of all the iterations
+  float max_error; // of the part positions compared to the scalar kernel
+  size_t mismatches; // legs further than LEG_SOLVER_TOLERANCE from the scalar kernel
+};
+
+// solves random legs without the ground with every kernel available on the CPU
+std::vector<LegSolverBenchmark> leg_solver_benchmark(const size_t legs_count, const size_t iterations);
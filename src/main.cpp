@@ -104,7 +104,8 @@ int main()
   imgui_setup(*static_cast<ZD::Window_GLFW *>(window.get()));
   ImGuiIO &imgui_io = ImGui::GetIO();
 
-  world->ground = std::make_unique<Ground>(*cfg->get_world_config());
+  world->terrain = std::make_shared<const TerrainField>(*cfg->get_world_config(), cfg->get_layers_config());
+  world->ground = std::make_unique<Ground>(*cfg->get_world_config(), world->terrain);
   world->ground->set_fog_color(world->sky_color);
   world->generate(*cfg);
 
@@ -119,20 +120,6 @@ int main()
 
   assert(world->mech);
 
-  // debug grid
-  for (auto &&idx_node : world->grid_map->nodes)
-  {
-    for (float zz = 0.0; zz < 1.0; zz += 1.0f)
-      for (float xx = 0.0; xx < 1.0; xx += 1.0f)
-      {
-        const float x = xx * world->ground->UNIT + idx_node.first.first * world->X_SPACING;
-        const float z = zz * world->ground->UNIT + idx_node.first.second * world->Z_SPACING;
-
-        const glm::vec3 pos { x, world->ground->get_y(x, z), z };
-        Debug::add_cube("Grid", pos);
-      }
-  }
-
   const double DELTA_TIME = 1.0 / 30.0;
   auto last_time = std::chrono::steady_clock::now();
   double accumulator = 0.0;
@@ -157,6 +144,7 @@ int main()
     while (accumulator >= DELTA_TIME)
     {
       renderer.update();
+      world->update(camera_position);
       world->mech->update(*world);
 
       float CAMERA_STEP_SIZE = 1.0;
@@ -186,7 +174,7 @@ int main()
 
       if (!camera_noclip)
       {
-        const double camera_min_y = world->ground->get_y(camera_position.x, camera_position.z);
+        const double camera_min_y = world->terrain->get_y(camera_position.x, camera_position.z);
         if (camera_position.y - 5.0f < camera_min_y)
         {
           camera_position.y = camera_min_y + 5.0f;
@@ -227,43 +215,35 @@ int main()
           const glm::vec3 click_direction_world_space = glm::normalize(click_world_space_forward - click_world_space);
 
           Debug::clear_cubes("Path");
-          glm::vec3 p = click_world_space;
-          const size_t MAX_RAY_STEPS = 1000;
-          const float RAY_STEP = 1.0f;
-          for (size_t i = 0; i < MAX_RAY_STEPS; i++)
+          if (const auto hit = world->ground->raycast(click_world_space, click_direction_world_space))
           {
-            p += click_direction_world_space * RAY_STEP;
-            const float click_y = world->ground->get_y(p.x, p.z);
-            if (p.y < click_y)
+            const glm::vec3 &p = hit->position;
+            Debug::add_cube("Path", p);
+
+            const int end_x = p.x / world->X_SPACING;
+            const int end_y = p.z / world->Z_SPACING;
+            int start_x = world->mech->get_position().x / world->X_SPACING;
+            int start_y = world->mech->get_position().z / world->Z_SPACING;
+
+            const auto &cost_profile = world->mech->get_cost_profile();
+            const auto cost_layer = world->grid_map->get_cost_layer(cost_profile);
+            size_t tries = 30;
+            while (tries > 0 && !cost_layer->contains({ start_x, start_y }))
             {
-              Debug::add_cube("Path", p);
-              Debug::add_cube("Path", glm::vec3(p.x, click_y, p.z));
-
-              const int end_x = p.x / world->X_SPACING;
-              const int end_y = p.z / world->Z_SPACING;
-              int start_x = world->mech->get_position().x / world->X_SPACING;
-              int start_y = world->mech->get_position().z / world->Z_SPACING;
-
-              size_t tries = 30;
-              while (tries > 0 && !world->grid_map->nodes.contains({ start_x, start_y }))
-              {
-                start_x = (start_x + 1);
-                start_y = (start_y + 1);
-                tries--;
-              }
-
-              auto path = world->grid_map->get_path(end_x, end_y, start_x, start_y);
-              for (const auto &idx : path)
-              {
-                const float x = idx.first * world->X_SPACING;
-                const float z = idx.second * world->Z_SPACING;
-                const glm::vec3 pos { x, world->ground->get_y(x, z), z };
-                Debug::add_cube("Path", pos);
-              }
-              world->mech->set_path(std::move(path));
-
-              break;
+              start_x = (start_x + 1);
+              start_y = (start_y + 1);
+              tries--;
             }
+
+            auto path = world->grid_map->get_path(end_x, end_y, start_x, start_y, cost_profile);
+            for (const auto &idx : path)
+            {
+              const float x = idx.first * world->X_SPACING;
+              const float z = idx.second * world->Z_SPACING;
+              const glm::vec3 pos { x, world->terrain->get_y(x, z), z };
+              Debug::add_cube("Path", pos);
+            }
+            world->mech->set_path(std::move(path));
           }
         }
       }
@@ -290,6 +270,11 @@ int main()
           Debug::ground_properties(*world->ground);
           ImGui::EndTabItem();
         }
+        if (ImGui::BeginTabItem("Visibility"))
+        {
+          Debug::visibility_properties(*world);
+          ImGui::EndTabItem();
+        }
         if (ImGui::BeginTabItem("Camera"))
         {
           ImGui::Text("Camera position: %6.4f, %6.4f, %6.4f", camera_position.x, camera_position.y, camera_position.z);
@@ -337,6 +322,7 @@ int main()
 
     sky.render(view);
 
+    world->ground->rasterize_occluders(view);
     world->mech->draw(view, *world);
     for (auto &&prop : world->props)
     {
@@ -1,4 +1,7 @@
+#include <algorithm>
+#include <chrono>
 #include <csignal>
+#include <span>
 
 #include "mech.hpp"
 
@@ -8,63 +11,7 @@
 
 #include "world.hpp"
 #include "debug.hpp"
-#include "ground.hpp"
-
-glm::quat rotation_between_vectors(glm::vec3 start, glm::vec3 dest)
-{
-  start = normalize(start);
-  dest = normalize(dest);
-
-  float cosTheta = dot(start, dest);
-  glm::vec3 rotationAxis;
-
-  if (cosTheta < -1.0f + 0.001f)
-  {
-    rotationAxis = glm::cross(glm::vec3(0.0f, 0.0f, 1.0f), start);
-    if (glm::length2(rotationAxis) < 0.01f)
-      rotationAxis = glm::cross(glm::vec3(1.0f, 0.0f, 0.0f), start);
-
-    rotationAxis = normalize(rotationAxis);
-    return glm::angleAxis((float)M_PI, rotationAxis);
-  }
-
-  rotationAxis = cross(start, dest);
-
-  float s = sqrt((1.0f + cosTheta) * 2.0f);
-  float invs = 1.0f / s;
-
-  return glm::quat(s * 0.5f, rotationAxis.x * invs, rotationAxis.y * invs, rotationAxis.z * invs);
-}
-
-glm::quat rotate_lookat(glm::quat q1, glm::quat q2, float max_angle)
-{
-  if (max_angle < 0.0001f)
-    return q1;
-
-  float cosTheta = glm::dot(q1, q2);
-  if (cosTheta > 0.9999f)
-    return q2;
-
-  if (cosTheta < 0)
-  {
-    q1 = q1 * -1.0f;
-    cosTheta *= -1.0f;
-  }
-
-  float angle = glm::acos(cosTheta);
-  if (cosTheta > 0.9999f || cosTheta < -0.9999f || angle < max_angle)
-    return q2;
-
-  if (angle < 1e-4f)
-    return q2;
-
-  float fT = max_angle / angle;
-
-  angle = max_angle;
-  glm::quat res = (glm::sin((1.0f - fT) * angle) * q1 + glm::sin(fT * angle) * q2) / glm::sin(angle);
-  res = glm::normalize(res);
-  return res;
-}
+#include "terrain.hpp"
 
 LegPart::LegPart(const size_t part_index)
 : ZD::Entity {}
@@ -88,27 +35,67 @@ LegPart::LegPart(const size_t part_index)
   add_model(model);
 }
 
-void LegPart::ground_collision(Ground &ground)
+static void clear_ground_probes(GroundProbes &probes)
 {
-  auto e = end();
-  float gye = ground.get_y(e.x, e.z);
+  probes.x.clear();
+  probes.z.clear();
+}
+
+static void add_ground_probe(GroundProbes &probes, const glm::vec3 &point)
+{
+  probes.x.push_back(point.x);
+  probes.z.push_back(point.z);
+}
+
+// heights of the triangulated ground under all the probes, the same as get_y
+static void sample_ground_probes(GroundProbes &probes, const TerrainField &terrain)
+{
+  probes.y.resize(probes.x.size());
+  terrain.get_surface_y_batch(probes.x, probes.z, probes.y);
+}
 
-  if (e.y < gye)
+// keeps the parts of the legs above the ground, the heights under all of them are sampled in one batch per step
+static void ground_collision(
+  LegChains::Part &part, std::span<const size_t> legs, const TerrainField &terrain, GroundProbes &probes)
+{
+  clear_ground_probes(probes);
+  for (const size_t l : legs)
+    add_ground_probe(probes, part.get_end(l));
+  sample_ground_probes(probes, terrain);
+  for (size_t k = 0; k < legs.size(); k++)
   {
-    position.y += gye - e.y;
+    const glm::vec3 e = part.get_end(legs[k]);
+    const float gye = probes.y[k];
+    if (e.y < gye)
+      part.y[legs[k]] += gye - e.y;
   }
-  
-  e = end();
-  gye = ground.get_y(e.x, e.z);
-  if (e.y - 0.5f < gye)
+
+  clear_ground_probes(probes);
+  for (const size_t l : legs)
+    add_ground_probe(probes, part.get_end(l));
+  sample_ground_probes(probes, terrain);
+  for (size_t k = 0; k < legs.size(); k++)
   {
-    const float dst = glm::distance({ e.x, gye, e.z }, e);
-    position -= rotation * forward() * (dst + 0.1f);
+    const size_t l = legs[k];
+    const glm::vec3 e = part.get_end(l);
+    const float gye = probes.y[k];
+    if (e.y - 0.5f < gye)
+    {
+      const float dst = glm::distance({ e.x, gye, e.z }, e);
+      part.set_position(l, part.get_position(l) - part.get_rotation(l) * LEG_FORWARD * (dst + 0.1f));
+    }
   }
 
-  const float gy = ground.get_y(position.x, position.z);
-  if (position.y < gy + 1.0f)
-    position.y = gy + 1.0f;
+  clear_ground_probes(probes);
+  for (const size_t l : legs)
+    add_ground_probe(probes, part.get_position(l));
+  sample_ground_probes(probes, terrain);
+  for (size_t k = 0; k < legs.size(); k++)
+  {
+    const float gy = probes.y[k];
+    if (part.y[legs[k]] < gy + 1.0f)
+      part.y[legs[k]] = gy + 1.0f;
+  }
 }
 
 Mech::Mech(glm::vec3 position)
@@ -138,24 +125,25 @@ Mech::Mech(glm::vec3 position)
 
 void Mech::set_legs_count(const size_t n)
 {
-  if (n <= 0 || n > 16384)
+  const size_t count = n <= 0 || n > 16384 ? 0 : n;
+  legs.resize(count);
+  for (size_t p = 0; p < LEG_PARTS; p++)
   {
-    legs_b.clear();
-    legs_m.clear();
-    legs_e.clear();
-    return;
+    leg_entities[p].resize(count);
+    for (auto &entity : leg_entities[p])
+      entity = std::make_unique<LegPart>(p);
   }
+  sync_leg_entities();
+}
 
-  legs_b.resize(n);
-  legs_m.resize(n);
-  legs_e.resize(n);
-
-  for (size_t i = 0; i < n; i++)
-  {
-    legs_b[i] = std::make_unique<LegPart>(0);
-    legs_m[i] = std::make_unique<LegPart>(1);
-    legs_e[i] = std::make_unique<LegPart>(2);
-  }
+void Mech::sync_leg_entities()
+{
+  for (size_t p = 0; p < LEG_PARTS; p++)
+    for (size_t l = 0; l < legs.size(); l++)
+    {
+      leg_entities[p][l]->set_position(legs.parts[p].get_position(l));
+      leg_entities[p][l]->set_rotation(legs.parts[p].get_rotation(l));
+    }
 }
 
 void Mech::step_path(const World &world)
@@ -167,7 +155,7 @@ void Mech::step_path(const World &world)
   {
     const float pt_x = xz.first * world.X_SPACING;
     const float pt_z = xz.second * world.Z_SPACING;
-    return glm::vec3 { pt_x, world.ground->get_y(pt_x, pt_z), pt_z };
+    return glm::vec3 { pt_x, world.terrain->get_y(pt_x, pt_z), pt_z };
   };
 
   glm::vec3 closest_path_point = get_3d_position(path.front());
@@ -206,15 +194,18 @@ void Mech::update([[maybe_unused]] const World &world)
   // move and rotate based on path
   step_path(world);
 
-  position.y = world.ground->get_y(position.x, position.z) + height;
+  position.y = world.terrain->get_y(position.x, position.z) + height;
 
-  if (legs_b.empty())
+  if (legs.size() == 0)
     return;
 
   // animate legs
+  const auto start = std::chrono::steady_clock::now();
   calculate_legs(world);
+  legs_time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+  sync_leg_entities();
 
-  const glm::vec3 normal = world.ground->get_n(position.x, position.z);
+  const glm::vec3 normal = world.terrain->get_n(position.x, position.z);
   Debug::clear_lines("Mech Normal");
   Debug::add_line("Mech Normal", position, position + normal * 30.0f);
   auto rot_y = rotation_between_vectors(glm::vec3 { 0.0f, 1.0f, 0.0f }, glm::normalize(normal));
@@ -224,34 +215,46 @@ void Mech::update([[maybe_unused]] const World &world)
 
 void Mech::calculate_legs([[maybe_unused]] const World &world)
 {
-  const float angle_step = 2.0f * M_PI / static_cast<float>(legs_b.size());
+  const float angle_step = 2.0f * M_PI / static_cast<float>(legs.size());
   const auto leg_angle = [&angle_step, this](auto leg_n) -> float
   { return static_cast<float>(leg_n) * angle_step + (angle_step / 2.0f) * angle_offset; };
 
   Debug::clear_cubes("Legs Target");
   Debug::clear_cubes("Legs Current Target");
 
-  if (legs_e.size() <= 0)
+  if (legs.size() <= 0)
     return;
 
-  const auto normal = world.ground->get_n(position.x, position.z);
-  const glm::vec3 ground { position.x, world.ground->get_y(position.x, position.z), position.z };
-  const float L_LENGTH = legs_e[0]->length() + legs_m[0]->length() + legs_b[0]->length();
+  LegChains::Part &lb = legs.parts[0];
+  LegChains::Part &lm = legs.parts[1];
+  LegChains::Part &le = legs.parts[2];
 
-  // set targets
-  for (size_t i = 0; i < legs_e.size(); ++i)
-  {
-    auto &le = legs_e[i];
-    [[maybe_unused]] auto &lm = legs_e[i];
-    [[maybe_unused]] auto &lb = legs_e[i];
+  const auto normal = world.terrain->get_n(position.x, position.z);
+  const glm::vec3 ground { position.x, world.terrain->get_y(position.x, position.z), position.z };
+  const float L_LENGTH = le.length[0] + lm.length[0] + lb.length[0];
+  const size_t legs_count = legs.size();
 
+  // the ground under the targets of all legs is sampled in one batch
+  std::vector<glm::vec3> targets(legs_count);
+  clear_ground_probes(probes);
+  for (size_t i = 0; i < legs_count; ++i)
+  {
     const float angle = leg_angle(i);
     const glm::quat rot = rotation * glm::angleAxis(angle, normal);
     const auto leg_forward = rotation * (glm::vec3 { 0.0f, 0.0f, 1.0f + legs_next_step_distance } + move_vec);
     const auto leg_spacing_vec = rot * glm::vec3 { legs_spacing, 0.0f, 0.0f };
-    auto target = position + leg_forward + leg_spacing_vec;
+    targets[i] = position + leg_forward + leg_spacing_vec;
+    add_ground_probe(probes, targets[i]);
+  }
+  sample_ground_probes(probes, *world.terrain);
 
-    target.y = world.ground->get_y(target.x, target.z);
+  // targets out of reach move toward the body and are sampled again
+  std::vector<uint8_t> valid_targets(legs_count, 0);
+  std::vector<size_t> moved_targets;
+  for (size_t i = 0; i < legs_count; ++i)
+  {
+    auto &target = targets[i];
+    target.y = probes.y[i];
 
     const auto ground_dir = glm::normalize(ground - target);
     if (glm::isnan(ground_dir).x)
@@ -261,88 +264,87 @@ void Mech::calculate_legs([[maybe_unused]] const World &world)
     if (range_dst > 1000.0)
       continue;
 
+    valid_targets[i] = 1;
     if (range_dst > 0.0f)
     {
       target += ground_dir * (0.7f + glm::abs(range_dst));
-      target.y = world.ground->get_y(target.x, target.z);
+      moved_targets.push_back(i);
     }
+  }
+  clear_ground_probes(probes);
+  for (const size_t i : moved_targets)
+    add_ground_probe(probes, targets[i]);
+  sample_ground_probes(probes, *world.terrain);
+  for (size_t k = 0; k < moved_targets.size(); ++k)
+    targets[moved_targets[k]].y = probes.y[k];
+
+  // set targets
+  for (size_t i = 0; i < legs_count; ++i)
+  {
+    if (!valid_targets[i])
+      continue;
+    const auto &target = targets[i];
 
-    if (glm::distance(position, le->target_position) > L_LENGTH)
+    if (glm::distance(position, legs.get_target(i)) > L_LENGTH)
     {
-      le->target_position = target;
+      legs.set_target(i, target);
     }
-    if (glm::distance(le->end(), target) >= legs_max_distance)
+    if (glm::distance(le.get_end(i), target) >= legs_max_distance)
     {
-      le->target_position = target;
+      legs.set_target(i, target);
     }
 
     Debug::add_cube("Legs Target", target);
-    Debug::add_cube("Legs Current Target", le->target_position);
+    Debug::add_cube("Legs Current Target", legs.get_target(i));
   }
 
   const float RSPEED = this->legs_rotation_speed / static_cast<float>(this->ik_iterations);
   glm::vec3 leg_center { 0.0f, 0.0f, 0.0f };
-  // inverse kinematics
-  for (size_t i = 0; i < ik_iterations; ++i)
+  // parts moved by a pass, the legs are independent so every pass handles the same part of all legs
+  // and their ground collisions share a cast
+  std::vector<size_t> moved;
+  moved.reserve(legs_count);
+  // inverse kinematics, converged legs drop out and the solve ends when all of them have converged
+  ik_convergence.reset(legs);
+  // a part turning at the capped speed must not pass for converged, or a slow rotation speed would end the solve
+  // after the first iteration with only a fraction of the turn applied
+  const float rotation_tolerance = ik_solver == LegSolverMethod::RotateToward
+                                   ? std::min(ik_rotation_tolerance, RSPEED * 0.5f)
+                                   : ik_rotation_tolerance;
+  size_t solved_iterations = 0; // summed over the legs
+  for (size_t i = 0; i < ik_iterations && ik_convergence.get_active_count() > 0; ++i)
   {
-    for (size_t l = 0; l < legs_e.size(); ++l)
-    {
-      auto &le = legs_e[l];
-      auto &lm = legs_m[l];
-      auto &lb = legs_b[l];
-
-      // inverse
-      if (glm::distance(le->target_position, le->begin()) > 1e-2)
-      {
-        // TODO: refactor into single method
-        auto le_dir = glm::normalize(le->target_position - le->begin());
-        le_dir = glm::normalize(le_dir * le->rotation_scalar);
-        if (!glm::isnan(le_dir).x)
-        {
-          le->set_rotation(rotate_lookat(le->get_rotation(), rotation_between_vectors(le->forward(), le_dir), RSPEED));
-          le->set_position(le->target_position);
-          le->ground_collision(*world.ground);
-        }
-      }
-
-      if (glm::distance(le->begin(), lm->begin()) > 1e-2)
-      {
-        auto lm_dir = glm::normalize(le->begin() - lm->begin());
-        lm_dir = glm::normalize(lm_dir * lm->rotation_scalar);
-        if (!glm::isnan(lm_dir).x)
-        {
-          lm->set_rotation(rotate_lookat(lm->get_rotation(), rotation_between_vectors(le->forward(), lm_dir), RSPEED));
-          lm->set_position(le->begin() - lm_dir * lm->length());
-          lm->ground_collision(*world.ground);
-        }
-      }
-
-      if (glm::distance(lm->begin(), lb->begin()) > 1e-2)
-      {
-        auto lb_dir = glm::normalize(lm->begin() - lb->begin());
-        lb_dir = glm::normalize(lb_dir * lb->rotation_scalar);
-        if (!glm::isnan(lb_dir).x)
-        {
-          lb->set_rotation(rotate_lookat(lb->get_rotation(), rotation_between_vectors(le->forward(), lb_dir), RSPEED));
-          lb->set_position(lm->begin() - lb_dir * lb->length());
-          lb->ground_collision(*world.ground);
-        }
-      }
-
-      // forward
-      lb->set_position(position);
-      lm->set_position(lb->end());
-      le->set_position(lm->end());
-
-      if (i == ik_iterations - 1)
-      {
-        leg_center += le->end();
-      }
-    }
+    const auto active = ik_convergence.get_active();
+    solved_iterations += ik_convergence.get_active_count();
+
+    // inverse, every part goes for the beginning of the next one and the foot for the target
+    const auto inverse_step = [&](LegChains::Part &part, const auto &goal_x, const auto &goal_y, const auto &goal_z) {
+      moved.clear();
+      if (ik_solver == LegSolverMethod::FABRIK)
+        fabrik_backward(part, goal_x, goal_y, goal_z, &part == &le, active, moved, legs_kernel);
+      else
+        reach_leg_goals(part, goal_x, goal_y, goal_z, &part == &le, RSPEED, active, moved, legs_kernel);
+      ground_collision(part, moved, *world.terrain, probes);
+    };
+    inverse_step(le, legs.target_x, legs.target_y, legs.target_z);
+    inverse_step(lm, le.x, le.y, le.z);
+    inverse_step(lb, lm.x, lm.y, lm.z);
+
+    // forward
+    if (ik_solver == LegSolverMethod::FABRIK)
+      fabrik_forward(legs, position, active, legs_kernel);
+    else
+      chain_leg_parts(legs, position, active, legs_kernel);
+
+    ik_convergence.update(legs, ik_position_tolerance, rotation_tolerance);
   }
+  ik_average_iterations = static_cast<float>(solved_iterations) / static_cast<float>(legs_count);
+  if (ik_iterations > 0)
+    for (size_t l = 0; l < legs_count; ++l)
+      leg_center += le.get_end(l);
 
-  //position += (leg_center - position) / static_cast<float>(legs_e.size()) * 0.0001f;
-  position.y += (position.y - (leg_center.y / static_cast<float>(legs_e.size()) + height)) * 0.4f;
+  //position += (leg_center - position) / static_cast<float>(legs.size()) * 0.0001f;
+  position.y += (position.y - (leg_center.y / static_cast<float>(legs.size()) + height)) * 0.4f;
 }
 
 void Mech::draw(ZD::View &view, [[maybe_unused]] const World &world)
@@ -350,10 +352,7 @@ void Mech::draw(ZD::View &view, [[maybe_unused]] const World &world)
   shader->use();
   body->render(*shader, view);
 
-  for (size_t i = 0; i < legs_b.size(); ++i)
-  {
-    legs_b[i]->render(*shader, view);
-    legs_m[i]->render(*shader, view);
-    legs_e[i]->render(*shader, view);
-  }
+  for (size_t i = 0; i < legs.size(); ++i)
+    for (const auto &parts : leg_entities)
+      parts[i]->render(*shader, view);
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <vector>
 
 #include "ZD/3rd/glm/glm.hpp"
@@ -13,36 +14,25 @@
 #include "ZD/Texture.hpp"
 #include "ZD/View.hpp"
 
-struct World;
-class Ground;
+#include "gridmap.hpp"
+#include "legsolver.hpp"
+#include "terrain.hpp"
 
-static constexpr std::array LEG_LENGTHS { 1.00f, 1.01f, 1.65f };
+struct World;
 
+// model of a part of a leg drawn at the transformation solved for it
 struct LegPart : public ZD::Entity
 {
   LegPart(const size_t part_index);
   virtual ~LegPart() = default;
 
   const size_t part_index;
-  constexpr inline float length() const
-  {
-    assert(part_index < LEG_LENGTHS.size());
-    return LEG_LENGTHS[part_index];
-  }
-
-  const inline glm::vec3 begin() const { return position; }
-
-  const inline glm::vec3 forward() const
-  {
-    return glm::vec3 { 1.0f, 0.0f, 0.0f };
-  }
-
-  const inline glm::vec3 end() const { return position + rotation * forward() * length(); }
-
-  void ground_collision(Ground &);
+};
 
-  glm::vec3 target_position { 0.0f, 0.0f, 0.0f };
-  glm::vec3 rotation_scalar { 1.0f, 1.0f, 1.0f };
+// points under which the ground height is looked up in one batch, kept between the ticks to not allocate
+struct GroundProbes
+{
+  std::vector<float> x, z, y;
 };
 
 class Mech : public ZD::Entity
@@ -54,7 +44,7 @@ public:
 
   inline void set_path(std::vector<std::pair<int, int>> &&path) { this->path = path; }
   void set_legs_count(const size_t n);
-  inline size_t get_legs_count() const { return legs_e.size(); }
+  inline size_t get_legs_count() const { return legs.size(); }
 
   inline constexpr void set_height(const float v) { height = v; }
   inline constexpr float get_height() const { return height; }
@@ -68,13 +58,15 @@ public:
   inline constexpr void set_angle_offset(const float v) { angle_offset = v; }
   inline constexpr float get_angle_offset() const { return angle_offset; }
 
+  inline constexpr void set_cost_profile(const GridMap::CostProfile &v) { cost_profile = v; }
+  inline constexpr const GridMap::CostProfile &get_cost_profile() const { return cost_profile; }
+
 private:
   std::shared_ptr<ZD::ShaderProgram> shader;
 
   std::unique_ptr<ZD::Entity> body;
-  std::vector<std::unique_ptr<LegPart>> legs_b;
-  std::vector<std::unique_ptr<LegPart>> legs_m;
-  std::vector<std::unique_ptr<LegPart>> legs_e;
+  LegChains legs;
+  std::array<std::vector<std::unique_ptr<LegPart>>, LEG_PARTS> leg_entities; // synced from the legs once per tick
   std::vector<std::pair<int, int>> path;
 
   float height { 1.5f };
@@ -86,11 +78,23 @@ private:
   float legs_spacing { 2.1f };
   float legs_max_distance { 2.6f };
   size_t ik_iterations { 20 };
+  LegSolverMethod ik_solver { LegSolverMethod::RotateToward };
+  // a leg has converged when an iteration moves its foot and turns its parts less than that
+  float ik_position_tolerance { 1e-3f };
+  float ik_rotation_tolerance { 1e-4f }; // radians, at most half of the turn allowed per iteration
+  float ik_average_iterations { 0.0f }; // per leg in the last solve
+  LegConvergence ik_convergence;
+
+  GridMap::CostProfile cost_profile;
 
   glm::vec3 move_vec { 0.0f, 0.0f, 0.0f };
+  GroundProbes probes; // ground under the legs
+  float legs_time { 0.0f }; // of the last solve in milliseconds
+  NoiseKernel legs_kernel { noise_kernel() };
 
   void step_path(const World &world);
   void calculate_legs(const World &world);
+  void sync_leg_entities();
 
   friend struct Debug;
 };
@@ -0,0 +1,504 @@
+#include "noise.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NOISE_X86
+#endif
+
+#define STB_PERLIN_IMPLEMENTATION
+#include "3rd/stb_perlin.h"
+
+namespace
+{
+  // stb tables widened for the vector gathers
+  struct NoiseTables
+  {
+    int randtab[512];
+    int grad_idx[512];
+    float grad_x[12];
+    float grad_y[12];
+    float grad_z[12];
+
+    NoiseTables()
+    {
+      static constexpr float basis[12][3] = { { 1, 1, 0 },  { -1, 1, 0 },  { 1, -1, 0 }, { -1, -1, 0 },
+                                              { 1, 0, 1 },  { -1, 0, 1 },  { 1, 0, -1 }, { -1, 0, -1 },
+                                              { 0, 1, 1 },  { 0, -1, 1 },  { 0, 1, -1 }, { 0, -1, -1 } };
+      for (size_t i = 0; i < 512; i++)
+      {
+        randtab[i] = stb__perlin_randtab[i];
+        grad_idx[i] = stb__perlin_randtab_grad_idx[i];
+      }
+      for (size_t i = 0; i < 12; i++)
+      {
+        grad_x[i] = basis[i][0];
+        grad_y[i] = basis[i][1];
+        grad_z[i] = basis[i][2];
+      }
+    }
+  };
+  const NoiseTables tables;
+
+  void perlin_noise3_scalar(const float *x, const float *y, const float z, float *out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+      out[i] = stb_perlin_noise3(x[i], y[i], z, 0, 0, 0);
+  }
+
+  inline float ease(const float a) { return ((a * 6 - 15) * a + 10) * a * a * a; }
+  inline float ease_derivative(const float a) { return 30.0f * a * a * (a - 1.0f) * (a - 1.0f); }
+  inline float lerp(const float a, const float b, const float t) { return a + (b - a) * t; }
+
+  // stb_perlin_noise3_internal with the derivatives of every interpolation step carried along,
+  // z is fixed so only the derivatives along x and y are needed
+  float perlin_noise3_gradient_scalar(float x, float y, float z, float &dx, float &dy)
+  {
+    const int px = stb__perlin_fastfloor(x);
+    const int py = stb__perlin_fastfloor(y);
+    const int pz = stb__perlin_fastfloor(z);
+    const int x0 = px & 255, x1 = (px + 1) & 255;
+    const int y0 = py & 255, y1 = (py + 1) & 255;
+    const int z0 = pz & 255, z1 = (pz + 1) & 255;
+
+    x -= px;
+    y -= py;
+    z -= pz;
+    const float u = ease(x), du = ease_derivative(x);
+    const float v = ease(y), dv = ease_derivative(y);
+    const float w = ease(z);
+
+    const int r0 = tables.randtab[x0];
+    const int r1 = tables.randtab[x1];
+    const int r00 = tables.randtab[r0 + y0];
+    const int r01 = tables.randtab[r0 + y1];
+    const int r10 = tables.randtab[r1 + y0];
+    const int r11 = tables.randtab[r1 + y1];
+
+    // value of a corner and the x, y components of its gradient
+    struct Corner
+    {
+      float n, gx, gy;
+    };
+    const auto corner = [](const int hash, const float cx, const float cy, const float cz) {
+      const int idx = tables.grad_idx[hash];
+      return Corner { tables.grad_x[idx] * cx + tables.grad_y[idx] * cy + tables.grad_z[idx] * cz,
+                      tables.grad_x[idx],
+                      tables.grad_y[idx] };
+    };
+    const auto lerp_corner = [](const Corner &a, const Corner &b, const float t) {
+      return Corner { lerp(a.n, b.n, t), lerp(a.gx, b.gx, t), lerp(a.gy, b.gy, t) };
+    };
+
+    const Corner n00 = lerp_corner(corner(r00 + z0, x, y, z), corner(r00 + z1, x, y, z - 1), w);
+    const Corner n01 = lerp_corner(corner(r01 + z0, x, y - 1, z), corner(r01 + z1, x, y - 1, z - 1), w);
+    const Corner n10 = lerp_corner(corner(r10 + z0, x - 1, y, z), corner(r10 + z1, x - 1, y, z - 1), w);
+    const Corner n11 = lerp_corner(corner(r11 + z0, x - 1, y - 1, z), corner(r11 + z1, x - 1, y - 1, z - 1), w);
+
+    Corner n0 = lerp_corner(n00, n01, v);
+    n0.gy += (n01.n - n00.n) * dv;
+    Corner n1 = lerp_corner(n10, n11, v);
+    n1.gy += (n11.n - n10.n) * dv;
+
+    dx = lerp(n0.gx, n1.gx, u) + (n1.n - n0.n) * du;
+    dy = lerp(n0.gy, n1.gy, u);
+    return lerp(n0.n, n1.n, u);
+  }
+
+  void perlin_noise3_gradient_scalar(
+    const float *x, const float *y, const float z, float *out, float *dx, float *dy, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+      out[i] = perlin_noise3_gradient_scalar(x[i], y[i], z, dx[i], dy[i]);
+  }
+
+#ifdef NOISE_X86
+
+  // the operation order follows stb_perlin_noise3_internal so results stay identical
+
+  __attribute__((target("avx2"))) inline __m256 ease8(const __m256 a)
+  {
+    const __m256 t = _mm256_add_ps(
+      _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(a, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f)), a),
+      _mm256_set1_ps(10.0f));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, a), a), a);
+  }
+
+  __attribute__((target("avx2"))) inline __m256 lerp8(const __m256 a, const __m256 b, const __m256 t)
+  {
+    return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+  }
+
+  __attribute__((target("avx2"))) inline __m256 grad8(
+    const __m256i hash, const __m256 x, const __m256 y, const __m256 z)
+  {
+    const __m256i idx = _mm256_i32gather_epi32(tables.grad_idx, hash, 4);
+    const __m256 gx = _mm256_i32gather_ps(tables.grad_x, idx, 4);
+    const __m256 gy = _mm256_i32gather_ps(tables.grad_y, idx, 4);
+    const __m256 gz = _mm256_i32gather_ps(tables.grad_z, idx, 4);
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gy, y)), _mm256_mul_ps(gz, z));
+  }
+
+  __attribute__((target("avx2"))) void perlin_noise3_avx2(
+    const float *x, const float *y, const float z, float *out, const size_t n)
+  {
+    const __m256i mask = _mm256_set1_epi32(255);
+    const __m256i one_i = _mm256_set1_epi32(1);
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    const float pz_f = std::floor(z);
+    const int pz = static_cast<int>(pz_f);
+    const __m256i z0 = _mm256_set1_epi32(pz & 255);
+    const __m256i z1 = _mm256_set1_epi32((pz + 1) & 255);
+    const __m256 zf = _mm256_set1_ps(z - pz_f);
+    const __m256 zf1 = _mm256_sub_ps(zf, one);
+    const __m256 w = ease8(zf);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      __m256 xf = _mm256_loadu_ps(x + i);
+      __m256 yf = _mm256_loadu_ps(y + i);
+      const __m256 px = _mm256_floor_ps(xf);
+      const __m256 py = _mm256_floor_ps(yf);
+      const __m256i ipx = _mm256_cvttps_epi32(px);
+      const __m256i ipy = _mm256_cvttps_epi32(py);
+      const __m256i x0 = _mm256_and_si256(ipx, mask);
+      const __m256i x1 = _mm256_and_si256(_mm256_add_epi32(ipx, one_i), mask);
+      const __m256i y0 = _mm256_and_si256(ipy, mask);
+      const __m256i y1 = _mm256_and_si256(_mm256_add_epi32(ipy, one_i), mask);
+
+      xf = _mm256_sub_ps(xf, px);
+      yf = _mm256_sub_ps(yf, py);
+      const __m256 u = ease8(xf);
+      const __m256 v = ease8(yf);
+      const __m256 xf1 = _mm256_sub_ps(xf, one);
+      const __m256 yf1 = _mm256_sub_ps(yf, one);
+
+      const __m256i r0 = _mm256_i32gather_epi32(tables.randtab, x0, 4);
+      const __m256i r1 = _mm256_i32gather_epi32(tables.randtab, x1, 4);
+      const __m256i r00 = _mm256_i32gather_epi32(tables.randtab, _mm256_add_epi32(r0, y0), 4);
+      const __m256i r01 = _mm256_i32gather_epi32(tables.randtab, _mm256_add_epi32(r0, y1), 4);
+      const __m256i r10 = _mm256_i32gather_epi32(tables.randtab, _mm256_add_epi32(r1, y0), 4);
+      const __m256i r11 = _mm256_i32gather_epi32(tables.randtab, _mm256_add_epi32(r1, y1), 4);
+
+      const __m256 n000 = grad8(_mm256_add_epi32(r00, z0), xf, yf, zf);
+      const __m256 n001 = grad8(_mm256_add_epi32(r00, z1), xf, yf, zf1);
+      const __m256 n010 = grad8(_mm256_add_epi32(r01, z0), xf, yf1, zf);
+      const __m256 n011 = grad8(_mm256_add_epi32(r01, z1), xf, yf1, zf1);
+      const __m256 n100 = grad8(_mm256_add_epi32(r10, z0), xf1, yf, zf);
+      const __m256 n101 = grad8(_mm256_add_epi32(r10, z1), xf1, yf, zf1);
+      const __m256 n110 = grad8(_mm256_add_epi32(r11, z0), xf1, yf1, zf);
+      const __m256 n111 = grad8(_mm256_add_epi32(r11, z1), xf1, yf1, zf1);
+
+      const __m256 n00 = lerp8(n000, n001, w);
+      const __m256 n01 = lerp8(n010, n011, w);
+      const __m256 n10 = lerp8(n100, n101, w);
+      const __m256 n11 = lerp8(n110, n111, w);
+
+      const __m256 n0 = lerp8(n00, n01, v);
+      const __m256 n1 = lerp8(n10, n11, v);
+
+      _mm256_storeu_ps(out + i, lerp8(n0, n1, u));
+    }
+
+    perlin_noise3_scalar(x + i, y + i, z, out + i, n - i);
+  }
+
+  __attribute__((target("avx2"))) inline __m256 ease_derivative8(const __m256 a)
+  {
+    const __m256 a1 = _mm256_sub_ps(a, _mm256_set1_ps(1.0f));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(30.0f), _mm256_mul_ps(a, a)), _mm256_mul_ps(a1, a1));
+  }
+
+  struct Corner8
+  {
+    __m256 n, gx, gy;
+  };
+
+  __attribute__((target("avx2"))) inline Corner8 corner8(
+    const __m256i hash, const __m256 x, const __m256 y, const __m256 z)
+  {
+    const __m256i idx = _mm256_i32gather_epi32(tables.grad_idx, hash, 4);
+    const __m256 gx = _mm256_i32gather_ps(tables.grad_x, idx, 4);
+    const __m256 gy = _mm256_i32gather_ps(tables.grad_y, idx, 4);
+    const __m256 gz = _mm256_i32gather_ps(tables.grad_z, idx, 4);
+    return { _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gy, y)), _mm256_mul_ps(gz, z)), gx, gy };
+  }
+
+  __attribute__((target("avx2"))) inline Corner8 lerp_corner8(const Corner8 &a, const Corner8 &b, const __m256 t)
+  {
+    return { lerp8(a.n, b.n, t), lerp8(a.gx, b.gx, t), lerp8(a.gy, b.gy, t) };
+  }
+
+  __attribute__((target("avx2"))) void perlin_noise3_gradient_avx2(
+    const float *x, const float *y, const float z, float *out, float *dx, float *dy, const size_t n)
+  {
+    const __m256i mask = _mm256_set1_epi32(255);
+    const __m256i one_i = _mm256_set1_epi32(1);
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    const float pz_f = std::floor(z);
+    const int pz = static_cast<int>(pz_f);
+    const __m256i z0 = _mm256_set1_epi32(pz & 255);
+    const __m256i z1 = _mm256_set1_epi32((pz + 1) & 255);
+    const __m256 zf = _mm256_set1_ps(z - pz_f);
+    const __m256 zf1 = _mm256_sub_ps(zf, one);
+    const __m256 w = ease8(zf);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      __m256 xf = _mm256_loadu_ps(x + i);
+      __m256 yf = _mm256_loadu_ps(y + i);
+      const __m256 px = _mm256_floor_ps(xf);
+      const __m256 py = _mm256_floor_ps(yf);
+      const __m256i ipx = _mm256_cvttps_epi32(px);
+      const __m256i ipy = _mm256_cvttps_epi32(py);
+      const __m256i x0 = _mm256_and_si256(ipx, mask);
+      const __m256i x1 = _mm256_and_si256(_mm256_add_epi32(ipx, one_i), mask);
+      const __m256i y0 = _mm256_and_si256(ipy, mask);
+      const __m256i y1 = _mm256_and_si256(_mm256_add_epi32(ipy, one_i), mask);
+
+      xf = _mm256_sub_ps(xf, px);
+      yf = _mm256_sub_ps(yf, py);
+      const __m256 u = ease8(xf);
+      const __m256 v = ease8(yf);
+      const __m256 du = ease_derivative8(xf);
+      const __m256 dv = ease_derivative8(yf);
+      const __m256 xf1 = _mm256_sub_ps(xf, one);
+      const __m256 yf1 = _mm256_sub_ps(yf, one);
+
+      const __m256i r0 = _mm256_i32gather_epi32(tables.randtab, x0, 4);
+      const __m256i r1 = _mm256_i32gather_epi32(tables.randtab, x1, 4);
+      const __m256i r00 = _mm256_i32gather_epi32(tables.randtab, _mm256_add_epi32(r0, y0), 4);
+      const __m256i r01 = _mm256_i32gather_epi32(tables.randtab, _mm256_add_epi32(r0, y1), 4);
+      const __m256i r10 = _mm256_i32gather_epi32(tables.randtab, _mm256_add_epi32(r1, y0), 4);
+      const __m256i r11 = _mm256_i32gather_epi32(tables.randtab, _mm256_add_epi32(r1, y1), 4);
+
+      const Corner8 n00 = lerp_corner8(
+        corner8(_mm256_add_epi32(r00, z0), xf, yf, zf), corner8(_mm256_add_epi32(r00, z1), xf, yf, zf1), w);
+      const Corner8 n01 = lerp_corner8(
+        corner8(_mm256_add_epi32(r01, z0), xf, yf1, zf), corner8(_mm256_add_epi32(r01, z1), xf, yf1, zf1), w);
+      const Corner8 n10 = lerp_corner8(
+        corner8(_mm256_add_epi32(r10, z0), xf1, yf, zf), corner8(_mm256_add_epi32(r10, z1), xf1, yf, zf1), w);
+      const Corner8 n11 = lerp_corner8(
+        corner8(_mm256_add_epi32(r11, z0), xf1, yf1, zf), corner8(_mm256_add_epi32(r11, z1), xf1, yf1, zf1), w);
+
+      Corner8 n0 = lerp_corner8(n00, n01, v);
+      n0.gy = _mm256_add_ps(n0.gy, _mm256_mul_ps(_mm256_sub_ps(n01.n, n00.n), dv));
+      Corner8 n1 = lerp_corner8(n10, n11, v);
+      n1.gy = _mm256_add_ps(n1.gy, _mm256_mul_ps(_mm256_sub_ps(n11.n, n10.n), dv));
+
+      _mm256_storeu_ps(out + i, lerp8(n0.n, n1.n, u));
+      _mm256_storeu_ps(dx + i, _mm256_add_ps(lerp8(n0.gx, n1.gx, u), _mm256_mul_ps(_mm256_sub_ps(n1.n, n0.n), du)));
+      _mm256_storeu_ps(dy + i, lerp8(n0.gy, n1.gy, u));
+    }
+
+    perlin_noise3_gradient_scalar(x + i, y + i, z, out + i, dx + i, dy + i, n - i);
+  }
+
+  __attribute__((target("sse4.1"))) inline __m128 ease4(const __m128 a)
+  {
+    const __m128 t =
+      _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(a, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f)), a), _mm_set1_ps(10.0f));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, a), a), a);
+  }
+
+  __attribute__((target("sse4.1"))) inline __m128 lerp4(const __m128 a, const __m128 b, const __m128 t)
+  {
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+  }
+
+  // SSE has no gathers, hashes are looked up per lane
+  __attribute__((target("sse4.1"))) inline __m128 grad4(
+    const int *hash, const int z_idx, const __m128 x, const __m128 y, const __m128 z)
+  {
+    alignas(16) float gx[4], gy[4], gz[4];
+    for (size_t k = 0; k < 4; k++)
+    {
+      const int idx = tables.grad_idx[hash[k] + z_idx];
+      gx[k] = tables.grad_x[idx];
+      gy[k] = tables.grad_y[idx];
+      gz[k] = tables.grad_z[idx];
+    }
+    return _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(_mm_load_ps(gx), x), _mm_mul_ps(_mm_load_ps(gy), y)), _mm_mul_ps(_mm_load_ps(gz), z));
+  }
+
+  __attribute__((target("sse4.1"))) void perlin_noise3_sse41(
+    const float *x, const float *y, const float z, float *out, const size_t n)
+  {
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    const float pz_f = std::floor(z);
+    const int pz = static_cast<int>(pz_f);
+    const int z0 = pz & 255;
+    const int z1 = (pz + 1) & 255;
+    const __m128 zf = _mm_set1_ps(z - pz_f);
+    const __m128 zf1 = _mm_sub_ps(zf, one);
+    const __m128 w = ease4(zf);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      __m128 xf = _mm_loadu_ps(x + i);
+      __m128 yf = _mm_loadu_ps(y + i);
+      const __m128 px = _mm_floor_ps(xf);
+      const __m128 py = _mm_floor_ps(yf);
+
+      alignas(16) int ipx[4], ipy[4];
+      _mm_store_si128(reinterpret_cast<__m128i *>(ipx), _mm_cvttps_epi32(px));
+      _mm_store_si128(reinterpret_cast<__m128i *>(ipy), _mm_cvttps_epi32(py));
+
+      alignas(16) int r00[4], r01[4], r10[4], r11[4];
+      for (size_t k = 0; k < 4; k++)
+      {
+        const int r0 = tables.randtab[ipx[k] & 255];
+        const int r1 = tables.randtab[(ipx[k] + 1) & 255];
+        r00[k] = tables.randtab[r0 + (ipy[k] & 255)];
+        r01[k] = tables.randtab[r0 + ((ipy[k] + 1) & 255)];
+        r10[k] = tables.randtab[r1 + (ipy[k] & 255)];
+        r11[k] = tables.randtab[r1 + ((ipy[k] + 1) & 255)];
+      }
+
+      xf = _mm_sub_ps(xf, px);
+      yf = _mm_sub_ps(yf, py);
+      const __m128 u = ease4(xf);
+      const __m128 v = ease4(yf);
+      const __m128 xf1 = _mm_sub_ps(xf, one);
+      const __m128 yf1 = _mm_sub_ps(yf, one);
+
+      const __m128 n00 = lerp4(grad4(r00, z0, xf, yf, zf), grad4(r00, z1, xf, yf, zf1), w);
+      const __m128 n01 = lerp4(grad4(r01, z0, xf, yf1, zf), grad4(r01, z1, xf, yf1, zf1), w);
+      const __m128 n10 = lerp4(grad4(r10, z0, xf1, yf, zf), grad4(r10, z1, xf1, yf, zf1), w);
+      const __m128 n11 = lerp4(grad4(r11, z0, xf1, yf1, zf), grad4(r11, z1, xf1, yf1, zf1), w);
+
+      const __m128 n0 = lerp4(n00, n01, v);
+      const __m128 n1 = lerp4(n10, n11, v);
+
+      _mm_storeu_ps(out + i, lerp4(n0, n1, u));
+    }
+
+    perlin_noise3_scalar(x + i, y + i, z, out + i, n - i);
+  }
+
+#endif
+} // namespace
+
+NoiseKernel noise_kernel()
+{
+#ifdef NOISE_X86
+  static const NoiseKernel best = []() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      return NoiseKernel::AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+      return NoiseKernel::SSE41;
+    return NoiseKernel::Scalar;
+  }();
+  return best;
+#else
+  return NoiseKernel::Scalar;
+#endif
+}
+
+const char *noise_kernel_name(const NoiseKernel kernel)
+{
+  switch (kernel)
+  {
+    case NoiseKernel::AVX2: return "AVX2";
+    case NoiseKernel::SSE41: return "SSE4.1";
+    case NoiseKernel::Scalar:
+    default: return "Scalar";
+  }
+}
+
+void perlin_noise3_batch(
+  std::span<const float> x, std::span<const float> y, const float z, std::span<float> out, const NoiseKernel kernel)
+{
+  const size_t n = std::min({ x.size(), y.size(), out.size() });
+
+  switch (kernel)
+  {
+#ifdef NOISE_X86
+    case NoiseKernel::AVX2: perlin_noise3_avx2(x.data(), y.data(), z, out.data(), n); break;
+    case NoiseKernel::SSE41: perlin_noise3_sse41(x.data(), y.data(), z, out.data(), n); break;
+#endif
+    case NoiseKernel::Scalar:
+    default: perlin_noise3_scalar(x.data(), y.data(), z, out.data(), n); break;
+  }
+}
+
+float perlin_noise3_gradient(const float x, const float y, const float z, float &dx, float &dy)
+{
+  return perlin_noise3_gradient_scalar(x, y, z, dx, dy);
+}
+
+void perlin_noise3_gradient_batch(
+  std::span<const float> x,
+  std::span<const float> y,
+  const float z,
+  std::span<float> out,
+  std::span<float> dx,
+  std::span<float> dy,
+  const NoiseKernel kernel)
+{
+  const size_t n = std::min({ x.size(), y.size(), out.size(), dx.size(), dy.size() });
+
+  // there is no SSE4.1 variant, it falls back to the scalar kernel
+  switch (kernel)
+  {
+#ifdef NOISE_X86
+    case NoiseKernel::AVX2:
+      perlin_noise3_gradient_avx2(x.data(), y.data(), z, out.data(), dx.data(), dy.data(), n);
+      break;
+#endif
+    case NoiseKernel::SSE41:
+    case NoiseKernel::Scalar:
+    default: perlin_noise3_gradient_scalar(x.data(), y.data(), z, out.data(), dx.data(), dy.data(), n); break;
+  }
+}
+
+std::vector<NoiseBenchmark> noise_benchmark(const size_t n)
+{
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> random(-1000.0f, 1000.0f);
+
+  std::vector<float> x(n), y(n), reference(n), out(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    x[i] = random(generator);
+    y[i] = random(generator);
+  }
+
+  std::vector<NoiseKernel> kernels { NoiseKernel::Scalar };
+  if (noise_kernel() == NoiseKernel::AVX2)
+    kernels.push_back(NoiseKernel::SSE41);
+  if (noise_kernel() != NoiseKernel::Scalar)
+    kernels.push_back(noise_kernel());
+
+  std::vector<NoiseBenchmark> results;
+  for (const auto kernel : kernels)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    perlin_noise3_batch(x, y, 100.0f, out, kernel);
+    const auto end = std::chrono::steady_clock::now();
+
+    if (kernel == NoiseKernel::Scalar)
+      reference = out;
+
+    float max_error = 0.0f;
+    for (size_t i = 0; i < n; i++)
+      max_error = std::max(max_error, std::fabs(out[i] - reference[i]));
+
+    const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    results.push_back({ kernel, ns / static_cast<double>(n), max_error });
+  }
+
+  return results;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+// stb_perlin_noise3(x, y, z, 0, 0, 0) evaluated for many points sharing the same z,
+// 8 points at once when the CPU supports it
+
+enum class NoiseKernel
+{
+  Scalar,
+  SSE41,
+  AVX2,
+};
+
+// the widest kernel supported by the CPU
+NoiseKernel noise_kernel();
+const char *noise_kernel_name(const NoiseKernel kernel);
+
+// vectorized kernels produce results equal to the scalar stb implementation up to NOISE_BATCH_TOLERANCE
+static constexpr float NOISE_BATCH_TOLERANCE { 1e-6f };
+
+void perlin_noise3_batch(
+  std::span<const float> x,
+  std::span<const float> y,
+  const float z,
+  std::span<float> out,
+  const NoiseKernel kernel = noise_kernel());
+
+// stb_perlin_noise3(x, y, z, 0, 0, 0) and its partial derivatives along x and y at a single point
+float perlin_noise3_gradient(const float x, const float y, const float z, float &dx, float &dy);
+
+// same values as perlin_noise3_batch together with the partial derivatives along x and y
+void perlin_noise3_gradient_batch(
+  std::span<const float> x,
+  std::span<const float> y,
+  const float z,
+  std::span<float> out,
+  std::span<float> dx,
+  std::span<float> dy,
+  const NoiseKernel kernel = noise_kernel());
+
+struct NoiseBenchmark
+{
+  NoiseKernel kernel;
+  double ns_per_point;
+  float max_error; // compared to the scalar kernel
+};
+
+// evaluates n points with every kernel available on the CPU
+std::vector<NoiseBenchmark> noise_benchmark(const size_t n);
@@ -0,0 +1,372 @@
+#include "noisestack.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+#include "noise.hpp"
+
+namespace
+{
+  static constexpr size_t BLOCK = 64;
+  using Block = std::array<float, BLOCK>;
+
+  template<NoiseLayer::Operator OP>
+  inline void combine(float &h, float &hx, float &hz, const float v, const float vx, const float vz)
+  {
+    if constexpr (OP == NoiseLayer::Operator::Add)
+    {
+      h = h + v;
+      hx += vx;
+      hz += vz;
+    }
+    else if constexpr (OP == NoiseLayer::Operator::Subtract)
+    {
+      h = h - v;
+      hx -= vx;
+      hz -= vz;
+    }
+    else if constexpr (OP == NoiseLayer::Operator::Multiply)
+    {
+      hx = hx * v + h * vx;
+      hz = hz * v + h * vz;
+      h = h * v;
+    }
+    else if constexpr (OP == NoiseLayer::Operator::Min)
+    {
+      if (v < h)
+      {
+        h = v;
+        hx = vx;
+        hz = vz;
+      }
+    }
+    else if constexpr (OP == NoiseLayer::Operator::Max)
+    {
+      if (v > h)
+      {
+        h = v;
+        hx = vx;
+        hz = vz;
+      }
+    }
+  }
+
+  template<NoiseLayer::Shaping SHAPING>
+  inline void shape(float &h, float &hx, float &hz, const float divisor)
+  {
+    if constexpr (SHAPING == NoiseLayer::Shaping::Valley)
+    {
+      // h * |h| / k has the derivative 2 * |h| / k
+      if (h < 0.0f)
+      {
+        const float slope = 2.0f * std::fabs(h) / divisor;
+        hx *= slope;
+        hz *= slope;
+        h *= std::fabs(h) / divisor;
+      }
+    }
+    else if constexpr (SHAPING == NoiseLayer::Shaping::Abs)
+    {
+      if (h < 0.0f)
+      {
+        h = -h;
+        hx = -hx;
+        hz = -hz;
+      }
+    }
+  }
+
+  // the loop over a block is instantiated for every operator and shaping so nothing is decided per point
+  template<NoiseLayer::Operator OP, NoiseLayer::Shaping SHAPING>
+  void combine_block(
+    const size_t count,
+    Block &h,
+    Block &hx,
+    Block &hz,
+    const Block &v,
+    const Block &vx,
+    const Block &vz,
+    const float divisor)
+  {
+    for (size_t k = 0; k < count; k++)
+    {
+      combine<OP>(h[k], hx[k], hz[k], v[k], vx[k], vz[k]);
+      shape<SHAPING>(h[k], hx[k], hz[k], divisor);
+    }
+  }
+
+  template<NoiseLayer::Operator OP>
+  void combine_block(
+    const NoiseLayer::Shaping shaping,
+    const size_t count,
+    Block &h,
+    Block &hx,
+    Block &hz,
+    const Block &v,
+    const Block &vx,
+    const Block &vz,
+    const float divisor)
+  {
+    switch (shaping)
+    {
+      case NoiseLayer::Shaping::Valley:
+        combine_block<OP, NoiseLayer::Shaping::Valley>(count, h, hx, hz, v, vx, vz, divisor);
+        break;
+      case NoiseLayer::Shaping::Abs:
+        combine_block<OP, NoiseLayer::Shaping::Abs>(count, h, hx, hz, v, vx, vz, divisor);
+        break;
+      case NoiseLayer::Shaping::None:
+      default: combine_block<OP, NoiseLayer::Shaping::None>(count, h, hx, hz, v, vx, vz, divisor); break;
+    }
+  }
+
+  // stb_perlin_noise3 stays within about [-1.04, 1.04], the bounds only have to hold
+  static constexpr float PERLIN_BOUND { 1.1f };
+
+  // range of f over [lo, hi] for the shaping functions, which are monotonic on either side of 0
+  template<typename F>
+  glm::vec2 shape_bounds(const glm::vec2 &bounds, F &&f)
+  {
+    const float a = f(bounds.x);
+    const float b = f(bounds.y);
+    glm::vec2 shaped { std::min(a, b), std::max(a, b) };
+    if (bounds.x < 0.0f && bounds.y > 0.0f)
+      shaped = { std::min(shaped.x, 0.0f), std::max(shaped.y, 0.0f) };
+    return shaped;
+  }
+
+  glm::vec2 parse_pair(const ConfigKeysValues &config, const std::string &key, const glm::vec2 alt)
+  {
+    if (!config.contains(key))
+      return alt;
+    // a single number is used for both axes
+    if (config.at(key).find(',') == std::string::npos)
+      return glm::vec2 { config.get_float(key) };
+    const auto [a, b] = config.get_range(key, { alt.x, alt.y });
+    return { a, b };
+  }
+} // namespace
+
+NoiseLayer NoiseLayer::from_config(const ConfigKeysValues &config)
+{
+  NoiseLayer layer;
+  layer.scale = parse_pair(config, "Scale", layer.scale);
+  layer.offset = parse_pair(config, "Offset", layer.offset);
+  layer.slice = config.get_float("Slice", layer.slice);
+  layer.amplitude = config.get_float("Amplitude", layer.amplitude);
+  layer.shaping_scale = config.get_float("ShapingScale", layer.shaping_scale);
+
+  const std::string op = config.get_string("Operator", "Add");
+  if (op == "Add")
+    layer.op = Operator::Add;
+  else if (op == "Subtract")
+    layer.op = Operator::Subtract;
+  else if (op == "Multiply")
+    layer.op = Operator::Multiply;
+  else if (op == "Min")
+    layer.op = Operator::Min;
+  else if (op == "Max")
+    layer.op = Operator::Max;
+  else
+    fprintf(stderr, "Unknown layer operator %s\n", op.c_str());
+
+  const std::string shaping = config.get_string("Shaping", "None");
+  if (shaping == "None")
+    layer.shaping = Shaping::None;
+  else if (shaping == "Valley")
+    layer.shaping = Shaping::Valley;
+  else if (shaping == "Abs")
+    layer.shaping = Shaping::Abs;
+  else
+    fprintf(stderr, "Unknown layer shaping %s\n", shaping.c_str());
+
+  if (layer.scale.x == 0.0f || layer.scale.y == 0.0f)
+  {
+    fprintf(stderr, "Layer scale cannot be zero\n");
+    layer.scale = { 1.0f, 1.0f };
+  }
+  return layer;
+}
+
+std::string NoiseLayer::describe() const
+{
+  static constexpr const char *OPERATORS[] = { "+", "-", "*", "min", "max" };
+  static constexpr const char *SHAPINGS[] = { "", " valley", " abs" };
+
+  char text[128];
+  snprintf(
+    text,
+    sizeof(text),
+    "%s %.2f x noise(%.0f, %.0f)%s",
+    OPERATORS[static_cast<size_t>(op)],
+    amplitude,
+    scale.x,
+    scale.y,
+    SHAPINGS[static_cast<size_t>(shaping)]);
+  return text;
+}
+
+std::vector<NoiseLayer> NoiseStack::default_layers()
+{
+  // the terrain of the original hard-coded generator
+  std::vector<NoiseLayer> layers(4);
+  layers[0].scale = { 100.0f, 100.0f };
+  layers[0].amplitude = 5.0f;
+  layers[1].scale = { 140.0f, 140.0f };
+  layers[1].amplitude = 8.0f;
+  layers[2].scale = { 20.0f, 20.0f };
+  layers[2].amplitude = 1.0f;
+  layers[2].op = NoiseLayer::Operator::Subtract;
+  layers[2].shaping = NoiseLayer::Shaping::Valley;
+  layers[2].shaping_scale = 20.0f;
+  layers[3].scale = { 50.0f, 60.0f };
+  layers[3].amplitude = 0.2f;
+  return layers;
+}
+
+std::vector<NoiseLayer> NoiseStack::from_config(const std::vector<std::shared_ptr<ConfigKeysValues>> &layers_config)
+{
+  if (layers_config.empty())
+    return default_layers();
+
+  std::vector<NoiseLayer> layers;
+  for (const auto &layer_config : layers_config)
+    layers.push_back(NoiseLayer::from_config(*layer_config));
+  return layers;
+}
+
+NoiseStack::NoiseStack(std::vector<NoiseLayer> layers, const float unit)
+: layers { std::move(layers) }
+{
+  for (const auto &layer : this->layers)
+  {
+    steps.push_back(Step { .scale = layer.scale,
+                           .offset = layer.offset,
+                           .slice = layer.slice,
+                           .amplitude = layer.amplitude,
+                           .unit = unit,
+                           .op = layer.op,
+                           .shaping = layer.shaping,
+                           .shaping_divisor = layer.shaping_scale * unit });
+  }
+
+  // interval arithmetic over the same steps as evaluate_batch
+  glm::vec2 h { 0.0f, 0.0f };
+  for (const auto &step : steps)
+  {
+    const float a = std::fabs(step.amplitude * step.unit) * PERLIN_BOUND;
+    const glm::vec2 v { -a, a };
+    switch (step.op)
+    {
+      case NoiseLayer::Operator::Add: h = { h.x + v.x, h.y + v.y }; break;
+      case NoiseLayer::Operator::Subtract: h = { h.x - v.y, h.y - v.x }; break;
+      case NoiseLayer::Operator::Multiply:
+      {
+        const std::array<float, 4> products { h.x * v.x, h.x * v.y, h.y * v.x, h.y * v.y };
+        const auto [lo, hi] = std::minmax_element(products.begin(), products.end());
+        h = { *lo, *hi };
+        break;
+      }
+      case NoiseLayer::Operator::Min: h = { std::min(h.x, v.x), std::min(h.y, v.y) }; break;
+      case NoiseLayer::Operator::Max: h = { std::max(h.x, v.x), std::max(h.y, v.y) }; break;
+    }
+    if (step.shaping == NoiseLayer::Shaping::Valley)
+      h = shape_bounds(h, [&](const float y) { return y < 0.0f ? y * std::fabs(y) / step.shaping_divisor : y; });
+    else if (step.shaping == NoiseLayer::Shaping::Abs)
+      h = shape_bounds(h, [](const float y) { return std::fabs(y); });
+  }
+  height_bounds = h;
+}
+
+float NoiseStack::evaluate(const float x, const float z) const
+{
+  float out;
+  evaluate_batch(std::span { &x, 1 }, std::span { &z, 1 }, std::span { &out, 1 }, {});
+  return out;
+}
+
+float NoiseStack::evaluate(const float x, const float z, glm::vec2 &gradient) const
+{
+  // the normal is (-dx, 1, -dz) normalized, the gradient is recovered from it
+  float out;
+  glm::vec3 normal;
+  evaluate_batch(std::span { &x, 1 }, std::span { &z, 1 }, std::span { &out, 1 }, std::span { &normal, 1 });
+  gradient = { -normal.x / normal.y, -normal.z / normal.y };
+  return out;
+}
+
+void NoiseStack::evaluate_batch(
+  std::span<const float> x, std::span<const float> z, std::span<float> out, std::span<glm::vec3> normals) const
+{
+  const size_t n = std::min({ x.size(), z.size(), out.size() });
+  const bool with_normals = !normals.empty();
+  assert(!with_normals || normals.size() >= n);
+
+  Block ox, oz, noise, noise_dx, noise_dz;
+  Block h, hx, hz, v, vx, vz;
+  for (size_t begin = 0; begin < n; begin += BLOCK)
+  {
+    const size_t count = std::min(BLOCK, n - begin);
+    const auto first = [count](Block &values) { return std::span { values }.first(count); };
+    h.fill(0.0f);
+    hx.fill(0.0f);
+    hz.fill(0.0f);
+
+    for (const auto &step : steps)
+    {
+      for (size_t k = 0; k < count; k++)
+      {
+        ox[k] = (x[begin + k] + step.offset.x) / step.scale.x;
+        oz[k] = (z[begin + k] + step.offset.y) / step.scale.y;
+      }
+
+      if (with_normals)
+      {
+        perlin_noise3_gradient_batch(
+          first(ox), first(oz), step.slice, first(noise), first(noise_dx), first(noise_dz));
+        for (size_t k = 0; k < count; k++)
+        {
+          vx[k] = noise_dx[k] / step.scale.x * step.amplitude * step.unit;
+          vz[k] = noise_dz[k] / step.scale.y * step.amplitude * step.unit;
+        }
+      }
+      else
+      {
+        perlin_noise3_batch(first(ox), first(oz), step.slice, first(noise));
+        vx.fill(0.0f);
+        vz.fill(0.0f);
+      }
+      for (size_t k = 0; k < count; k++)
+        v[k] = noise[k] * step.amplitude * step.unit;
+
+      switch (step.op)
+      {
+        case NoiseLayer::Operator::Add:
+          combine_block<NoiseLayer::Operator::Add>(step.shaping, count, h, hx, hz, v, vx, vz, step.shaping_divisor);
+          break;
+        case NoiseLayer::Operator::Subtract:
+          combine_block<NoiseLayer::Operator::Subtract>(
+            step.shaping, count, h, hx, hz, v, vx, vz, step.shaping_divisor);
+          break;
+        case NoiseLayer::Operator::Multiply:
+          combine_block<NoiseLayer::Operator::Multiply>(
+            step.shaping, count, h, hx, hz, v, vx, vz, step.shaping_divisor);
+          break;
+        case NoiseLayer::Operator::Min:
+          combine_block<NoiseLayer::Operator::Min>(step.shaping, count, h, hx, hz, v, vx, vz, step.shaping_divisor);
+          break;
+        case NoiseLayer::Operator::Max:
+          combine_block<NoiseLayer::Operator::Max>(step.shaping, count, h, hx, hz, v, vx, vz, step.shaping_divisor);
+          break;
+      }
+    }
+
+    std::copy_n(h.begin(), count, out.begin() + begin);
+    if (with_normals)
+      for (size_t k = 0; k < count; k++)
+        normals[begin + k] = glm::normalize(glm::vec3 { -hx[k], 1.0f, -hz[k] });
+  }
+}
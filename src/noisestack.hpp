@@ -0,0 +1,82 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "ZD/3rd/glm/glm.hpp"
+
+#include "config.hpp"
+
+// single Perlin layer of the terrain, heights are in UNITs
+struct NoiseLayer
+{
+  enum class Operator
+  {
+    Add,
+    Subtract,
+    Multiply,
+    Min,
+    Max,
+  };
+
+  // applied to the height accumulated so far after the layer is combined into it
+  enum class Shaping
+  {
+    None,
+    Valley, // negative heights are flattened with h * |h| / ShapingScale
+    Abs,
+  };
+
+  glm::vec2 scale { 100.0f, 100.0f }; // wavelength along x and z in world units
+  glm::vec2 offset { 0.0f, 0.0f }; // added to the world position before scaling
+  float slice { 100.0f }; // z coordinate of the 3D noise
+  float amplitude { 1.0f };
+  Operator op { Operator::Add };
+  Shaping shaping { Shaping::None };
+  float shaping_scale { 20.0f };
+
+  static NoiseLayer from_config(const ConfigKeysValues &config);
+  std::string describe() const;
+};
+
+// layers of world.ini flattened into a list of steps evaluated over blocks of points,
+// every step runs one vectorized noise batch and one tight loop specialized for its operator
+class NoiseStack final
+{
+public:
+  NoiseStack(std::vector<NoiseLayer> layers, const float unit);
+  // the layers used when world.ini has no Layer sections
+  static std::vector<NoiseLayer> default_layers();
+  static std::vector<NoiseLayer> from_config(const std::vector<std::shared_ptr<ConfigKeysValues>> &layers_config);
+
+  float evaluate(const float x, const float z) const;
+  // gradient of the height along x and z
+  float evaluate(const float x, const float z, glm::vec2 &gradient) const;
+  // normals are optional, they come from the analytic derivatives of the same evaluation
+  void evaluate_batch(
+    std::span<const float> x, std::span<const float> z, std::span<float> out, std::span<glm::vec3> normals) const;
+
+  inline const std::vector<NoiseLayer> &get_layers() const { return layers; }
+  // lowest and highest height the layers can produce anywhere, conservative
+  inline glm::vec2 get_height_bounds() const { return height_bounds; }
+
+private:
+  // layer with the amplitude and shaping scale premultiplied where it keeps the results exact
+  struct Step
+  {
+    glm::vec2 scale;
+    glm::vec2 offset;
+    float slice;
+    float amplitude;
+    float unit;
+    NoiseLayer::Operator op;
+    NoiseLayer::Shaping shaping;
+    float shaping_divisor;
+  };
+
+  std::vector<NoiseLayer> layers;
+  std::vector<Step> steps;
+  glm::vec2 height_bounds;
+};
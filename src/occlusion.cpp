@@ -0,0 +1,118 @@
+#include "occlusion.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+OcclusionBuffer::OcclusionBuffer(const size_t width, const size_t height)
+: width { std::max<size_t>(1, width) }
+, height { std::max<size_t>(1, height) }
+, depth(this->width * this->height, 1.0f)
+{
+}
+
+void OcclusionBuffer::clear(const glm::mat4 &view_projection)
+{
+  this->view_projection = view_projection;
+  std::fill(depth.begin(), depth.end(), 1.0f);
+  triangles_count = 0;
+}
+
+void OcclusionBuffer::add_quad(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, const glm::vec3 &d)
+{
+  std::array<glm::vec3, 4> screen;
+  const std::array<const glm::vec3 *, 4> corners { &a, &b, &c, &d };
+  for (size_t k = 0; k < corners.size(); k++)
+  {
+    const glm::vec4 clip = view_projection * glm::vec4 { *corners[k], 1.0f };
+    // in front of the near plane, a partial quad is not worth the clipping
+    if (clip.z < -clip.w || clip.w <= 0.0f)
+      return;
+    screen[k] = { (clip.x / clip.w * 0.5f + 0.5f) * width,
+                  (clip.y / clip.w * 0.5f + 0.5f) * height,
+                  clip.z / clip.w };
+  }
+  rasterize(screen[0], screen[1], screen[2]);
+  rasterize(screen[2], screen[3], screen[0]);
+}
+
+void OcclusionBuffer::rasterize(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+  const float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+  if (area == 0.0f)
+    return;
+
+  // pixels with the centres inside of the triangle
+  const ssize_t min_x = std::max<ssize_t>(0, std::ceil(std::min({ a.x, b.x, c.x }) - 0.5f));
+  const ssize_t max_x = std::min<ssize_t>(width - 1, std::floor(std::max({ a.x, b.x, c.x }) - 0.5f));
+  const ssize_t min_y = std::max<ssize_t>(0, std::ceil(std::min({ a.y, b.y, c.y }) - 0.5f));
+  const ssize_t max_y = std::min<ssize_t>(height - 1, std::floor(std::max({ a.y, b.y, c.y }) - 0.5f));
+  if (min_x > max_x || min_y > max_y)
+    return;
+  triangles_count++;
+
+  // edge functions normalized by the area are the barycentric weights, stepped along x
+  const float inverse_area = 1.0f / area;
+  const auto edge = [inverse_area](const glm::vec3 &p, const glm::vec3 &q) {
+    return glm::vec3 { (p.y - q.y) * inverse_area, (q.x - p.x) * inverse_area, (p.x * q.y - p.y * q.x) * inverse_area };
+  };
+  const glm::vec3 e0 = edge(b, c);
+  const glm::vec3 e1 = edge(c, a);
+  const glm::vec3 e2 = edge(a, b);
+
+  for (ssize_t y = min_y; y <= max_y; y++)
+  {
+    const float py = y + 0.5f;
+    const float px = min_x + 0.5f;
+    float w0 = e0.x * px + e0.y * py + e0.z;
+    float w1 = e1.x * px + e1.y * py + e1.z;
+    float w2 = e2.x * px + e2.y * py + e2.z;
+    float *row = depth.data() + y * width;
+    for (ssize_t x = min_x; x <= max_x; x++)
+    {
+      if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f)
+        row[x] = std::min(row[x], w0 * a.z + w1 * b.z + w2 * c.z);
+      w0 += e0.x;
+      w1 += e1.x;
+      w2 += e2.x;
+    }
+  }
+}
+
+bool OcclusionBuffer::is_occluded(const glm::vec3 &min, const glm::vec3 &max) const
+{
+  float min_x = INFINITY, max_x = -INFINITY, min_y = INFINITY, max_y = -INFINITY;
+  float nearest = 1.0f;
+  for (size_t k = 0; k < 8; k++)
+  {
+    const glm::vec3 corner { k & 1 ? max.x : min.x, k & 2 ? max.y : min.y, k & 4 ? max.z : min.z };
+    const glm::vec4 clip = view_projection * glm::vec4 { corner, 1.0f };
+    if (clip.z < -clip.w || clip.w <= 0.0f)
+      return false;
+    const float x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+    const float y = (clip.y / clip.w * 0.5f + 0.5f) * height;
+    min_x = std::min(min_x, x);
+    max_x = std::max(max_x, x);
+    min_y = std::min(min_y, y);
+    max_y = std::max(max_y, y);
+    nearest = std::min(nearest, clip.z / clip.w);
+  }
+
+  // out of the screen, that is up to the frustum culling
+  if (max_x < 0.0f || max_y < 0.0f || min_x > width || min_y > height)
+    return false;
+
+  // a pixel more around, the occluders cover only the centres of the pixels
+  const ssize_t x0 = std::max<ssize_t>(0, std::floor(min_x) - 1);
+  const ssize_t x1 = std::min<ssize_t>(width - 1, std::floor(max_x) + 1);
+  const ssize_t y0 = std::max<ssize_t>(0, std::floor(min_y) - 1);
+  const ssize_t y1 = std::min<ssize_t>(height - 1, std::floor(max_y) + 1);
+  for (ssize_t y = y0; y <= y1; y++)
+  {
+    const float *row = depth.data() + y * width;
+    for (ssize_t x = x0; x <= x1; x++)
+      if (row[x] >= nearest)
+        return false;
+  }
+  return true;
+}
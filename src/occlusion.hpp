@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "ZD/3rd/glm/glm.hpp"
+
+// coarse depth buffer filled on the CPU with geometry lying under the surface of an occluder,
+// boxes behind it at every pixel they cover cannot be seen and do not have to be submitted
+//
+// depth is the normalized device z, triangles crossing the near plane are dropped
+// and boxes crossing it are never occluded, so the test errs on the side of drawing
+class OcclusionBuffer final
+{
+public:
+  OcclusionBuffer(const size_t width, const size_t height);
+
+  // clears the depth for the transformation of a new frame
+  void clear(const glm::mat4 &view_projection);
+  // the corners go around the quad, both sides occlude
+  void add_quad(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, const glm::vec3 &d);
+  // true only when the whole box is behind the occluders
+  bool is_occluded(const glm::vec3 &min, const glm::vec3 &max) const;
+
+  inline size_t get_width() const { return width; }
+  inline size_t get_height() const { return height; }
+  inline size_t get_triangles_count() const { return triangles_count; }
+
+private:
+  // x and y in pixels, z in the depth range
+  void rasterize(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c);
+
+  const size_t width;
+  const size_t height;
+  std::vector<float> depth; // row-major from the bottom row
+  glm::mat4 view_projection { 1.0f };
+  size_t triangles_count { 0 };
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// calls f(i) for every i in [begin, end), contiguous ranges of indices run on separate hardware threads,
+// every thread gets at least grain indices so that small ranges run inline instead of paying for the threads
+template<typename F>
+void parallel_for(const size_t begin, const size_t end, F &&f, const size_t grain = 1)
+{
+  const size_t n = end > begin ? end - begin : 0;
+  const size_t threads_n =
+    std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), n / std::max<size_t>(1, grain));
+
+  if (threads_n <= 1)
+  {
+    for (size_t i = begin; i < end; i++)
+      f(i);
+    return;
+  }
+
+  std::vector<std::jthread> threads;
+  threads.reserve(threads_n);
+  for (size_t t = 0; t < threads_n; t++)
+  {
+    const size_t range_begin = begin + n * t / threads_n;
+    const size_t range_end = begin + n * (t + 1) / threads_n;
+    threads.emplace_back([&f, range_begin, range_end]() {
+      for (size_t i = range_begin; i < range_end; i++)
+        f(i);
+    });
+  }
+}
@@ -13,10 +13,21 @@ PropBuilder::PropBuilder(const std::vector<std::shared_ptr<ConfigKeysValues>> &k
     if (prop_keys_values->contains("Elevation"))
       elevation = prop_keys_values->get_range("Elevation");
 
-    props.insert({ elevation, std::make_shared<Prop>(prop_keys_values) });
+    auto prop = std::make_shared<Prop>(prop_keys_values);
+    prop->prototype = prototypes.size();
+    prototypes.push_back(prop);
+    props.insert({ elevation, std::move(prop) });
   }
 }
-std::shared_ptr<Prop> PropBuilder::copy_at_position(const glm::vec3 position) const
+
+std::shared_ptr<Prop> PropBuilder::copy(const size_t prototype) const
+{
+  if (prototype >= prototypes.size())
+    return {};
+  return std::make_shared<Prop>(*prototypes[prototype]);
+}
+
+std::shared_ptr<Prop> PropBuilder::copy_at_position(const glm::vec3 position, std::mt19937 &generator) const
 {
   std::vector<std::shared_ptr<Prop>> valid_props;
 
@@ -31,9 +42,8 @@ std::shared_ptr<Prop> PropBuilder::copy_at_position(const glm::vec3 position) co
   if (valid_props.empty())
     return {};
 
-  static std::random_device rd;
   std::uniform_int_distribution<int> random(0, valid_props.size() - 1);
-  const size_t idx = random(rd);
+  const size_t idx = random(generator);
   return std::make_shared<Prop>(*valid_props[idx]);
 }
 
@@ -72,6 +82,7 @@ Prop::Prop(const std::shared_ptr<ConfigKeysValues> keys_values)
   add_model(std::move(model));
 
   this->scale *= keys_values->get_float("Scale", 1.0f);
+  radius = keys_values->get_float("Radius", 0.0f) * keys_values->get_float("Scale", 1.0f);
 
   if (!Prop::default_shader)
   {
@@ -105,6 +116,11 @@ void Prop::draw(const ZD::View &view, const World &world)
   if (has_transulency && distance_to_camera > 800.0f)
     return;
 
+  // hidden behind the hills
+  const glm::vec3 extent { radius, radius, radius };
+  if (radius > 0.0f && world.ground->is_occluded(this->position - extent, this->position + extent))
+    return;
+
   auto &shader = this->shader ? *this->shader : *Prop::default_shader;
   shader.use();
 
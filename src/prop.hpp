@@ -1,5 +1,6 @@
 #pragma once
 
+#include <random>
 #include <set>
 
 #include "ZD/Model.hpp"
@@ -21,6 +22,8 @@ public:
   bool has_transulency { false };
   const std::shared_ptr<ConfigKeysValues> keys_values;
   double cost { 1.0 };
+  float radius { 0.0f }; // of the sphere around the origin enclosing the model, props without it are never occluded
+  size_t prototype { 0 }; // index of the Prop section the prop was copied from
 
 private:
   std::shared_ptr<ZD::ShaderProgram> shader;
@@ -31,8 +34,11 @@ class PropBuilder final
 {
 public:
   PropBuilder(const std::vector<std::shared_ptr<ConfigKeysValues>> &keys_values);
-  std::shared_ptr<Prop> copy_at_position(const glm::vec3 position) const;
+  std::shared_ptr<Prop> copy_at_position(const glm::vec3 position, std::mt19937 &generator) const;
+  std::shared_ptr<Prop> copy(const size_t prototype) const;
+  inline size_t get_prototypes_count() const { return prototypes.size(); }
 
 private:
   std::set<std::pair<std::pair<float, float>, std::shared_ptr<Prop>>> props;
+  std::vector<std::shared_ptr<Prop>> prototypes; // in the order of the config sections
 };
@@ -0,0 +1,412 @@
+#include "terrain.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TERRAIN_X86
+#endif
+
+#include "noise.hpp"
+
+TerrainField::TerrainField(
+  const ConfigKeysValues &world_config, const std::vector<std::shared_ptr<ConfigKeysValues>> &layers_config)
+: noise { NoiseStack::from_config(layers_config), UNIT }
+, tiles { noise, UNIT, static_cast<size_t>(std::max(1, world_config.get_int("HeightCacheTiles", 256))) }
+{
+}
+
+// height of the triangle of the quad under the point at px, pz inside of it
+static float interpolate_quad(const QuadCorners &quad, const float px, const float pz)
+{
+  if (px == 0.0 && pz == 0.0)
+    return quad.y[0];
+
+  // interpolation for fractional values
+  const float y00 = quad.y[0];
+  const float y10 = px > pz ? quad.y[1] : quad.y[2];
+  const float y11 = quad.y[3];
+
+  if ((px == 1.0 && pz == 0.0) || (px == 0.0 && pz == 1.0))
+    return y10;
+
+  const float xv1 = 0.0f;
+  const float yv1 = 0.0f;
+  const float xv2 = px > pz ? 1.0f : 0.0f;
+  const float yv2 = px > pz ? 0.0f : 1.0f;
+  const float xv3 = 1.0f;
+  const float yv3 = 1.0f;
+
+  const float b = (yv2 - yv3) * (xv1 - xv3) + (xv3 - xv2) * (yv1 - yv3);
+  const float w1 = ((yv2 - yv3) * (px - xv3) + (xv3 - xv2) * (pz - yv3)) / b;
+  const float w2 = ((yv3 - yv1) * (px - xv3) + (xv1 - xv3) * (pz - yv3)) / b;
+  const float w3 = 1.0f - w1 - w2;
+
+  return w1 * y00 + w2 * y10 + w3 * y11;
+}
+
+float TerrainField::get_y(const float x, const float z) const
+{
+  const float fx = std::floor(x / UNIT);
+  const float fz = std::floor(z / UNIT);
+  const ssize_t i = static_cast<ssize_t>(fx);
+  const ssize_t j = static_cast<ssize_t>(fz);
+
+  const float px = (x - fx * UNIT) / UNIT;
+  const float pz = (z - fz * UNIT) / UNIT;
+  return interpolate_quad(tiles.get_quad(i, j), px, pz);
+}
+
+void TerrainField::get_surface_y_batch(std::span<const float> x, std::span<const float> z, std::span<float> out) const
+{
+  const size_t n = std::min({ x.size(), z.size(), out.size() });
+  for (size_t k = 0; k < n; k++)
+  {
+    const float fx = std::floor(x[k] / UNIT);
+    const float fz = std::floor(z[k] / UNIT);
+    const float px = (x[k] - fx * UNIT) / UNIT;
+    const float pz = (z[k] - fz * UNIT) / UNIT;
+    out[k] = interpolate_quad(tiles.get_quad(static_cast<ssize_t>(fx), static_cast<ssize_t>(fz)), px, pz);
+  }
+}
+
+glm::vec3 TerrainField::get_n(const float x, const float z) const
+{
+  const float fx = std::floor(x / UNIT);
+  const float fz = std::floor(z / UNIT);
+  const ssize_t i = static_cast<ssize_t>(fx);
+  const ssize_t j = static_cast<ssize_t>(fz);
+  const float px = (x - fx * UNIT) / UNIT;
+  const float pz = (z - fz * UNIT) / UNIT;
+
+  const QuadCorners quad = tiles.get_quad(i, j);
+  if (px == 0.0 && pz == 0.0)
+    return quad.n[0];
+
+  // blend normals of the triangle vertices with barycentric weights
+  const bool lower = px > pz;
+  const float w1 = 1.0f - (lower ? px : pz);
+  const float w2 = lower ? px - pz : pz - px;
+  const float w3 = lower ? pz : px;
+  const glm::vec3 &n10 = lower ? quad.n[1] : quad.n[2];
+  return glm::normalize(w1 * quad.n[0] + w2 * n10 + w3 * quad.n[3]);
+}
+
+glm::vec3 TerrainField::get_face_n(const float x, const float z) const
+{
+  const float fx = std::floor(x / UNIT);
+  const float fz = std::floor(z / UNIT);
+  const ssize_t i = static_cast<ssize_t>(fx);
+  const ssize_t j = static_cast<ssize_t>(fz);
+  const bool lower = (x - fx * UNIT) > (z - fz * UNIT);
+
+  const QuadCorners quad = tiles.get_quad(i, j);
+  const float y00 = quad.y[0];
+  const float y11 = quad.y[3];
+  if (lower)
+  {
+    const float y10 = quad.y[1];
+    return glm::normalize(glm::vec3 { y00 - y10, UNIT, y10 - y11 });
+  }
+  const float y01 = quad.y[2];
+  return glm::normalize(glm::vec3 { y01 - y11, UNIT, y00 - y01 });
+}
+
+void TerrainField::get_y_batch(std::span<const float> x, std::span<const float> z, std::span<float> out) const
+{
+  noise.evaluate_batch(x, z, out, {});
+}
+
+void TerrainField::get_y_batch(
+  std::span<const float> x, std::span<const float> z, std::span<float> out, std::span<glm::vec3> normals) const
+{
+  noise.evaluate_batch(x, z, out, normals);
+}
+
+void TerrainRayBatch::clear()
+{
+  for (auto *v : { &origin_x, &origin_y, &origin_z, &direction_x, &direction_y, &direction_z })
+    v->clear();
+  max_distance.clear();
+  distance.clear();
+  normal.clear();
+}
+
+size_t TerrainRayBatch::add(const glm::vec3 &origin, const glm::vec3 &direction, const float max_distance)
+{
+  origin_x.push_back(origin.x);
+  origin_y.push_back(origin.y);
+  origin_z.push_back(origin.z);
+  direction_x.push_back(direction.x);
+  direction_y.push_back(direction.y);
+  direction_z.push_back(direction.z);
+  // NaN and negative distances end the ray at its origin
+  this->max_distance.push_back(max_distance > 0.0f ? std::min(max_distance, MAX_DISTANCE) : 0.0f);
+  return size() - 1;
+}
+
+namespace
+{
+  // first parameter in [t0, t1] where the ray is on or below the surface of the cell, INFINITY when there is none,
+  // positions are relative to the first corner in grid units and the heights in world units
+  //
+  // the height above either triangle is linear along the ray, so the part in the cell is split
+  // where it crosses the diagonal and every piece is tested at its ends
+  inline float cast_cell(
+    const float x,
+    const float z,
+    const float dx,
+    const float dz,
+    const float y,
+    const float dy,
+    const float y00,
+    const float y10,
+    const float y01,
+    const float y11,
+    const float t0,
+    const float t1,
+    uint8_t &lower)
+  {
+    const auto clearance = [&](const float t, const bool lower) {
+      const float px = x + dx * t;
+      const float pz = z + dz * t;
+      const float surface =
+        lower ? y00 + (y10 - y00) * px + (y11 - y10) * pz : y00 + (y11 - y01) * px + (y01 - y00) * pz;
+      return y + dy * t - surface;
+    };
+    const auto is_lower = [&](const float t) { return x + dx * t > z + dz * t; };
+
+    const float diagonal = dx - dz;
+    const float td = diagonal != 0.0f ? (z - x) / diagonal : t1;
+    const float tm = std::clamp(td, t0, t1);
+    const bool lower0 = is_lower((t0 + tm) * 0.5f);
+    const bool lower1 = is_lower((tm + t1) * 0.5f);
+    const float c0 = clearance(t0, lower0);
+    const float cm = clearance(tm, lower0);
+    const float c1 = clearance(t1, lower1);
+
+    if (c0 <= 0.0f)
+    {
+      lower = lower0;
+      return t0;
+    }
+    if (cm <= 0.0f)
+    {
+      lower = lower0;
+      return t0 + (tm - t0) * c0 / (c0 - cm);
+    }
+    if (c1 <= 0.0f)
+    {
+      lower = lower1;
+      return tm + (t1 - tm) * cm / (cm - c1);
+    }
+    return INFINITY;
+  }
+
+  void cast_cells_scalar(TerrainRayBatch::Walk &w, const size_t begin, const size_t n)
+  {
+    for (size_t k = begin; k < n; k++)
+      w.t[k] = cast_cell(
+        w.x[k], w.z[k], w.dx[k], w.dz[k], w.y[k], w.dy[k], w.y00[k], w.y10[k], w.y01[k], w.y11[k], w.t0[k], w.t1[k],
+        w.lower[k]);
+  }
+
+#ifdef TERRAIN_X86
+
+  // rays of 8 lanes relative to the corner of their cells, the slopes of both triangles along x and z
+  struct CellRays8
+  {
+    __m256 x, z, dx, dz, y, dy, y00;
+    __m256 lower_sx, lower_sz, upper_sx, upper_sz;
+  };
+
+  __attribute__((target("avx2,fma"))) inline __m256 clearance8(
+    const CellRays8 &r, const __m256 t, const __m256 lower)
+  {
+    const __m256 px = _mm256_fmadd_ps(r.dx, t, r.x);
+    const __m256 pz = _mm256_fmadd_ps(r.dz, t, r.z);
+    const __m256 sx = _mm256_blendv_ps(r.upper_sx, r.lower_sx, lower);
+    const __m256 sz = _mm256_blendv_ps(r.upper_sz, r.lower_sz, lower);
+    const __m256 surface = _mm256_fmadd_ps(sz, pz, _mm256_fmadd_ps(sx, px, r.y00));
+    return _mm256_sub_ps(_mm256_fmadd_ps(r.dy, t, r.y), surface);
+  }
+
+  __attribute__((target("avx2,fma"))) inline __m256 is_lower8(const CellRays8 &r, const __m256 t)
+  {
+    return _mm256_cmp_ps(_mm256_fmadd_ps(r.dx, t, r.x), _mm256_fmadd_ps(r.dz, t, r.z), _CMP_GT_OQ);
+  }
+
+  // the same operations as cast_cell for 8 rays, the lanes without a hit get INFINITY
+  __attribute__((target("avx2,fma"))) void cast_cells_avx2(TerrainRayBatch::Walk &w, const size_t n)
+  {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 infinity = _mm256_set1_ps(INFINITY);
+
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8)
+    {
+      CellRays8 r;
+      r.x = _mm256_loadu_ps(w.x.data() + k);
+      r.z = _mm256_loadu_ps(w.z.data() + k);
+      r.dx = _mm256_loadu_ps(w.dx.data() + k);
+      r.dz = _mm256_loadu_ps(w.dz.data() + k);
+      r.y = _mm256_loadu_ps(w.y.data() + k);
+      r.dy = _mm256_loadu_ps(w.dy.data() + k);
+      r.y00 = _mm256_loadu_ps(w.y00.data() + k);
+      const __m256 y10 = _mm256_loadu_ps(w.y10.data() + k);
+      const __m256 y01 = _mm256_loadu_ps(w.y01.data() + k);
+      const __m256 y11 = _mm256_loadu_ps(w.y11.data() + k);
+      r.lower_sx = _mm256_sub_ps(y10, r.y00);
+      r.lower_sz = _mm256_sub_ps(y11, y10);
+      r.upper_sx = _mm256_sub_ps(y11, y01);
+      r.upper_sz = _mm256_sub_ps(y01, r.y00);
+      const __m256 t0 = _mm256_loadu_ps(w.t0.data() + k);
+      const __m256 t1 = _mm256_loadu_ps(w.t1.data() + k);
+
+      const __m256 diagonal = _mm256_sub_ps(r.dx, r.dz);
+      const __m256 crossing = _mm256_cmp_ps(diagonal, zero, _CMP_NEQ_OQ);
+      const __m256 td = _mm256_blendv_ps(t1, _mm256_div_ps(_mm256_sub_ps(r.z, r.x), diagonal), crossing);
+      const __m256 tm = _mm256_min_ps(_mm256_max_ps(td, t0), t1);
+      const __m256 lower0 = is_lower8(r, _mm256_mul_ps(_mm256_add_ps(t0, tm), half));
+      const __m256 lower1 = is_lower8(r, _mm256_mul_ps(_mm256_add_ps(tm, t1), half));
+      const __m256 c0 = clearance8(r, t0, lower0);
+      const __m256 cm = clearance8(r, tm, lower0);
+      const __m256 c1 = clearance8(r, t1, lower1);
+
+      // the checks of cast_cell in reverse so the first one met wins
+      const __m256 below0 = _mm256_cmp_ps(c0, zero, _CMP_LE_OQ);
+      const __m256 belowm = _mm256_cmp_ps(cm, zero, _CMP_LE_OQ);
+      const __m256 below1 = _mm256_cmp_ps(c1, zero, _CMP_LE_OQ);
+      const __m256 t_first = _mm256_fmadd_ps(_mm256_sub_ps(tm, t0), _mm256_div_ps(c0, _mm256_sub_ps(c0, cm)), t0);
+      const __m256 t_second = _mm256_fmadd_ps(_mm256_sub_ps(t1, tm), _mm256_div_ps(cm, _mm256_sub_ps(cm, c1)), tm);
+      __m256 t = _mm256_blendv_ps(infinity, t_second, below1);
+      __m256 lower = _mm256_and_ps(lower1, below1);
+      t = _mm256_blendv_ps(t, t_first, belowm);
+      lower = _mm256_blendv_ps(lower, lower0, belowm);
+      t = _mm256_blendv_ps(t, t0, below0);
+      lower = _mm256_blendv_ps(lower, lower0, below0);
+
+      _mm256_storeu_ps(w.t.data() + k, t);
+      const int lower_bits = _mm256_movemask_ps(lower);
+      for (size_t l = 0; l < 8; l++)
+        w.lower[k + l] = (lower_bits >> l) & 1;
+    }
+
+    cast_cells_scalar(w, k, n);
+  }
+
+#endif
+} // namespace
+
+void TerrainField::cast_batch(TerrainRayBatch &batch) const
+{
+  const size_t n = batch.size();
+  batch.distance.assign(n, INFINITY);
+  batch.normal.assign(n, glm::vec3 { 0.0f, 1.0f, 0.0f });
+
+  // every ray starts in the cell of its origin, x and z in grid units from here on
+  TerrainRayBatch::Walk &w = batch.walk;
+  w.rays.resize(n);
+  w.i.resize(n);
+  w.j.resize(n);
+  w.next_x.resize(n);
+  w.next_z.resize(n);
+  w.t0.resize(n);
+  for (size_t r = 0; r < n; r++)
+  {
+    const float gx = batch.origin_x[r] / UNIT;
+    const float gz = batch.origin_z[r] / UNIT;
+    const float dx = batch.direction_x[r];
+    const float dz = batch.direction_z[r];
+    w.rays[r] = r;
+    w.i[r] = static_cast<ssize_t>(std::floor(gx));
+    w.j[r] = static_cast<ssize_t>(std::floor(gz));
+    w.next_x[r] = dx != 0.0f ? (w.i[r] + (dx > 0.0f ? 1 : 0) - gx) * UNIT / dx : INFINITY;
+    w.next_z[r] = dz != 0.0f ? (w.j[r] + (dz > 0.0f ? 1 : 0) - gz) * UNIT / dz : INFINITY;
+    w.t0[r] = 0.0f;
+  }
+
+#ifdef TERRAIN_X86
+  const bool avx2 = noise_kernel() == NoiseKernel::AVX2;
+#endif
+  // a rising ray above every possible height cannot hit anything further on
+  const float highest = noise.get_height_bounds().y;
+
+  while (!w.rays.empty())
+  {
+    const size_t active = w.rays.size();
+    for (auto *v : { &w.t1, &w.x, &w.z, &w.dx, &w.dz, &w.y, &w.dy, &w.y00, &w.y10, &w.y01, &w.y11, &w.t })
+      v->resize(active);
+    w.lower.resize(active);
+
+    // corners of the current cells are gathered from the tiles
+    for (size_t k = 0; k < active; k++)
+    {
+      const uint32_t r = w.rays[k];
+      const QuadCorners quad = tiles.get_quad(w.i[k], w.j[k]);
+      w.t1[k] = std::min({ w.next_x[k], w.next_z[k], batch.max_distance[r] });
+      w.x[k] = batch.origin_x[r] / UNIT - w.i[k];
+      w.z[k] = batch.origin_z[r] / UNIT - w.j[k];
+      w.dx[k] = batch.direction_x[r] / UNIT;
+      w.dz[k] = batch.direction_z[r] / UNIT;
+      w.y[k] = batch.origin_y[r];
+      w.dy[k] = batch.direction_y[r];
+      w.y00[k] = quad.y[0];
+      w.y10[k] = quad.y[1];
+      w.y01[k] = quad.y[2];
+      w.y11[k] = quad.y[3];
+    }
+
+#ifdef TERRAIN_X86
+    if (avx2)
+      cast_cells_avx2(w, active);
+    else
+      cast_cells_scalar(w, 0, active);
+#else
+    cast_cells_scalar(w, 0, active);
+#endif
+
+    // rays with a hit or at their max distance are done, the others step into the next cell
+    size_t walking = 0;
+    for (size_t k = 0; k < active; k++)
+    {
+      const uint32_t r = w.rays[k];
+      if (std::isfinite(w.t[k]))
+      {
+        batch.distance[r] = w.t[k];
+        batch.normal[r] = w.lower[k] ? glm::normalize(glm::vec3 { w.y00[k] - w.y10[k], UNIT, w.y10[k] - w.y11[k] })
+                                     : glm::normalize(glm::vec3 { w.y01[k] - w.y11[k], UNIT, w.y00[k] - w.y01[k] });
+        continue;
+      }
+      if (w.t1[k] >= batch.max_distance[r])
+        continue;
+      if (w.dy[k] >= 0.0f && w.y[k] + w.dy[k] * w.t1[k] > highest)
+        continue;
+
+      w.rays[walking] = r;
+      w.t0[walking] = w.t1[k];
+      w.i[walking] = w.i[k];
+      w.j[walking] = w.j[k];
+      w.next_x[walking] = w.next_x[k];
+      w.next_z[walking] = w.next_z[k];
+      if (w.next_x[k] < w.next_z[k])
+      {
+        w.i[walking] += batch.direction_x[r] > 0.0f ? 1 : -1;
+        w.next_x[walking] += UNIT / std::fabs(batch.direction_x[r]);
+      }
+      else
+      {
+        w.j[walking] += batch.direction_z[r] > 0.0f ? 1 : -1;
+        w.next_z[walking] += UNIT / std::fabs(batch.direction_z[r]);
+      }
+      walking++;
+    }
+    for (auto *v : { &w.next_x, &w.next_z, &w.t0 })
+      v->resize(walking);
+    w.rays.resize(walking);
+    w.i.resize(walking);
+    w.j.resize(walking);
+  }
+}
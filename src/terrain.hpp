@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "ZD/3rd/glm/glm.hpp"
+
+#include "config.hpp"
+#include "heightcache.hpp"
+#include "noisestack.hpp"
+
+// rays cast at the terrain in one call, stored as separate arrays of components
+// and kept between the casts so that casting does not allocate once the arrays have grown
+struct TerrainRayBatch
+{
+  // longer or non-finite max distances are clamped to it when a ray is added
+  static constexpr float MAX_DISTANCE { 100000.0f };
+
+  std::vector<float> origin_x, origin_y, origin_z;
+  std::vector<float> direction_x, direction_y, direction_z; // normalized
+  std::vector<float> max_distance;
+
+  // distance to the first point on or below the surface, 0 for rays starting under it
+  // and INFINITY for rays that do not reach it within their max distance
+  std::vector<float> distance;
+  std::vector<glm::vec3> normal; // of the hit triangle
+
+  void clear();
+  size_t add(const glm::vec3 &origin, const glm::vec3 &direction, const float max_distance);
+  inline size_t size() const { return origin_x.size(); }
+  inline bool is_hit(const size_t k) const { return std::isfinite(distance[k]); }
+  inline glm::vec3 get_hit_position(const size_t k) const
+  {
+    return { origin_x[k] + direction_x[k] * distance[k],
+             origin_y[k] + direction_y[k] * distance[k],
+             origin_z[k] + direction_z[k] * distance[k] };
+  }
+
+  // the cell every unfinished ray is crossing, filled and consumed by the cast
+  struct Walk
+  {
+    std::vector<uint32_t> rays;
+    std::vector<ssize_t> i, j;
+    std::vector<float> next_x, next_z, t0, t1;
+    std::vector<float> x, z, dx, dz, y, dy, y00, y10, y01, y11, t;
+    std::vector<uint8_t> lower;
+  } walk;
+};
+
+// the terrain surface without any of its rendering, triangulated on the UNIT grid the same way as the ground chunks
+//
+// the description never changes after construction, any number of threads may query it at once
+// without locks or allocations, only the tile cache behind the queries is updated
+class TerrainField final
+{
+public:
+  // the terrain is the stack of Layer sections, the original octaves when there are none
+  TerrainField(
+    const ConfigKeysValues &world_config, const std::vector<std::shared_ptr<ConfigKeysValues>> &layers_config);
+
+  float get_y(const float x, const float z) const;
+  glm::vec3 get_n(const float x, const float z) const;
+  glm::vec3 get_face_n(const float x, const float z) const;
+
+  // get_y at many points, the heights of the same triangles the ground is drawn with
+  void get_surface_y_batch(std::span<const float> x, std::span<const float> z, std::span<float> out) const;
+  // samples the noise surface at many points with the vectorized noise kernel,
+  // equal to get_y at grid vertices up to NOISE_BATCH_TOLERANCE * UNIT
+  void get_y_batch(std::span<const float> x, std::span<const float> z, std::span<float> out) const;
+  // also writes the normals of the noise surface from the analytic derivatives of the same evaluation
+  void get_y_batch(
+    std::span<const float> x, std::span<const float> z, std::span<float> out, std::span<glm::vec3> normals) const;
+
+  // intersects every ray of the batch with the triangles of the cells it crosses, the rays walk the cells
+  // in lockstep and every step tests the current cells of 8 rays at once when the CPU supports it
+  void cast_batch(TerrainRayBatch &batch) const;
+
+  inline const NoiseStack &get_noise() const { return noise; }
+  inline HeightTileCache::Stats get_tile_stats() const { return tiles.get_stats(); }
+  // statistics are diagnostics, resetting them does not change any query
+  inline void reset_tile_stats() const { tiles.reset_stats(); }
+
+  const float UNIT { 10.0f };
+
+private:
+  NoiseStack noise;
+  mutable HeightTileCache tiles;
+};
@@ -0,0 +1,218 @@
+#include "visibility.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "parallel.hpp"
+
+// how deep below the surface a segment has to go to be blocked, points on the ground still see each other
+static constexpr float SIGHT_EPSILON { 1e-3f };
+// queries per thread of a batch, a query takes microseconds and a thread about as long as a hundred of them
+static constexpr size_t QUERIES_GRAIN { 256 };
+
+// parameters of the part of the segment inside of the rectangle, empty when the first one is greater
+static std::pair<float, float> clip_segment(
+  const glm::vec3 &origin, const glm::vec3 &delta, const float x0, const float z0, const float x1, const float z1)
+{
+  float t0 = 0.0f;
+  float t1 = 1.0f;
+  const std::array<std::array<float, 4>, 2> slabs { { { origin.x, delta.x, x0, x1 }, { origin.z, delta.z, z0, z1 } } };
+  for (const auto &[o, d, lo, hi] : slabs)
+  {
+    if (d == 0.0f)
+    {
+      if (o < lo || o > hi)
+        return { 1.0f, 0.0f };
+      continue;
+    }
+    const float ta = (lo - o) / d;
+    const float tb = (hi - o) / d;
+    t0 = std::max(t0, std::min(ta, tb));
+    t1 = std::min(t1, std::max(ta, tb));
+  }
+  return { t0, t1 };
+}
+
+TerrainVisibility::TerrainVisibility(
+  std::shared_ptr<const TerrainField> terrain,
+  const ssize_t i0,
+  const ssize_t j0,
+  const ssize_t cells_x,
+  const ssize_t cells_z)
+: terrain { std::move(terrain) }
+, i0 { i0 }
+, j0 { j0 }
+, cells_x { std::max<ssize_t>(1, cells_x) }
+, cells_z { std::max<ssize_t>(1, cells_z) }
+{
+}
+
+void TerrainVisibility::build() const
+{
+  std::call_once(built, &TerrainVisibility::build_levels, this);
+}
+
+void TerrainVisibility::build_levels() const
+{
+  // exact corners of the triangulated surface, the rows are independent
+  const float unit = terrain->UNIT;
+  heights.resize((cells_x + 1) * (cells_z + 1));
+  parallel_for(0, cells_z + 1, [&](const size_t row) {
+    const ssize_t cj = row;
+    for (ssize_t ci = 0; ci <= cells_x; ci++)
+      heights[cj * (cells_x + 1) + ci] = terrain->get_y((i0 + ci) * unit, (j0 + cj) * unit);
+  });
+
+  std::vector<glm::vec2> cell_bounds(cells_x * cells_z);
+  for (ssize_t cj = 0; cj < cells_z; cj++)
+    for (ssize_t ci = 0; ci < cells_x; ci++)
+    {
+      const auto [lo, hi] =
+        std::minmax({ corner(ci, cj), corner(ci + 1, cj), corner(ci, cj + 1), corner(ci + 1, cj + 1) });
+      cell_bounds[cj * cells_x + ci] = { lo, hi };
+    }
+  levels.push_back(std::move(cell_bounds));
+  level_sizes.push_back({ cells_x, cells_z });
+
+  // every next level merges up to 2x2 blocks of the previous one
+  while (level_sizes.back().first > 1 || level_sizes.back().second > 1)
+  {
+    const auto [w, h] = level_sizes.back();
+    const ssize_t next_w = (w + 1) / 2;
+    const ssize_t next_h = (h + 1) / 2;
+    const std::vector<glm::vec2> &finer = levels.back();
+    std::vector<glm::vec2> bounds(next_w * next_h, glm::vec2 { INFINITY, -INFINITY });
+    for (ssize_t bj = 0; bj < h; bj++)
+      for (ssize_t bi = 0; bi < w; bi++)
+      {
+        glm::vec2 &b = bounds[(bj / 2) * next_w + bi / 2];
+        b.x = std::min(b.x, finer[bj * w + bi].x);
+        b.y = std::max(b.y, finer[bj * w + bi].y);
+      }
+    levels.push_back(std::move(bounds));
+    level_sizes.push_back({ next_w, next_h });
+  }
+}
+
+bool TerrainVisibility::line_of_sight(const glm::vec3 &from, const glm::vec3 &to) const
+{
+  build();
+  const float unit = terrain->UNIT;
+  const glm::vec3 origin { from.x / unit - i0, from.y, from.z / unit - j0 };
+  const glm::vec3 target { to.x / unit - i0, to.y, to.z / unit - j0 };
+  return !is_blocked(Segment { origin, target - origin }, levels.size() - 1, 0, 0);
+}
+
+void TerrainVisibility::line_of_sight_batch(
+  std::span<const glm::vec3> from, std::span<const glm::vec3> to, std::span<uint8_t> out) const
+{
+  const size_t n = std::min({ from.size(), to.size(), out.size() });
+  parallel_for(0, n, [&](const size_t k) { out[k] = line_of_sight(from[k], to[k]); }, QUERIES_GRAIN);
+}
+
+std::vector<std::pair<int, int>> TerrainVisibility::get_viewshed(
+  const glm::vec3 &eye,
+  const GridMap &grid_map,
+  const glm::vec2 &spacing,
+  const float max_distance,
+  const float target_height) const
+{
+  std::vector<std::pair<int, int>> cells;
+  for (const auto &key : grid_map.get_node_keys())
+  {
+    const float dx = key.first * spacing.x - eye.x;
+    const float dz = key.second * spacing.y - eye.z;
+    if (dx * dx + dz * dz <= max_distance * max_distance)
+      cells.push_back(key);
+  }
+
+  std::vector<uint8_t> visible(cells.size());
+  parallel_for(
+    0,
+    cells.size(),
+    [&](const size_t k) {
+      const float x = cells[k].first * spacing.x;
+      const float z = cells[k].second * spacing.y;
+      visible[k] = line_of_sight(eye, { x, terrain->get_y(x, z) + target_height, z });
+    },
+    QUERIES_GRAIN);
+
+  std::vector<std::pair<int, int>> seen;
+  for (size_t k = 0; k < cells.size(); k++)
+    if (visible[k])
+      seen.push_back(cells[k]);
+  return seen;
+}
+
+bool TerrainVisibility::is_blocked(
+  const Segment &segment, const size_t level, const ssize_t bi, const ssize_t bj) const
+{
+  const auto [w, h] = level_sizes[level];
+  if (bi >= w || bj >= h)
+    return false;
+
+  const ssize_t size = ssize_t { 1 } << level;
+  const auto [t0, t1] = clip_segment(
+    segment.origin,
+    segment.delta,
+    bi * size,
+    bj * size,
+    std::min((bi + 1) * size, cells_x),
+    std::min((bj + 1) * size, cells_z));
+  if (t0 > t1)
+    return false;
+
+  const float y0 = segment.origin.y + segment.delta.y * t0;
+  const float y1 = segment.origin.y + segment.delta.y * t1;
+  const glm::vec2 &bounds = levels[level][bj * w + bi];
+  if (std::min(y0, y1) > bounds.y)
+    return false;
+  if (std::max(y0, y1) < bounds.x - SIGHT_EPSILON)
+    return true;
+  if (level == 0)
+    return is_cell_blocked(segment, bi, bj, t0, t1);
+
+  // the child closer to the origin first, a blocked segment usually stops early
+  const ssize_t flip_x = segment.delta.x < 0.0f ? 1 : 0;
+  const ssize_t flip_z = segment.delta.z < 0.0f ? 1 : 0;
+  for (ssize_t k = 0; k < 4; k++)
+    if (is_blocked(segment, level - 1, bi * 2 + ((k & 1) ^ flip_x), bj * 2 + ((k >> 1) ^ flip_z)))
+      return true;
+  return false;
+}
+
+bool TerrainVisibility::is_cell_blocked(
+  const Segment &segment, const ssize_t ci, const ssize_t cj, const float t0, const float t1) const
+{
+  const float y00 = corner(ci, cj);
+  const float y10 = corner(ci + 1, cj);
+  const float y01 = corner(ci, cj + 1);
+  const float y11 = corner(ci + 1, cj + 1);
+
+  // height above the surface, linear on either side of the diagonal of the quad
+  const auto clearance = [&](const float t, const bool lower) {
+    const float px = segment.origin.x + segment.delta.x * t - ci;
+    const float pz = segment.origin.z + segment.delta.z * t - cj;
+    const float surface =
+      lower ? y00 + (y10 - y00) * px + (y11 - y10) * pz : y00 + (y11 - y01) * px + (y01 - y00) * pz;
+    return segment.origin.y + segment.delta.y * t - surface;
+  };
+  const auto is_lower = [&](const float t) {
+    return segment.origin.x + segment.delta.x * t - ci > segment.origin.z + segment.delta.z * t - cj;
+  };
+  const auto is_piece_blocked = [&](const float ta, const float tb) {
+    const bool lower = is_lower((ta + tb) * 0.5f);
+    return clearance(ta, lower) < -SIGHT_EPSILON || clearance(tb, lower) < -SIGHT_EPSILON;
+  };
+
+  // the diagonal px = pz splits the part of the segment in the cell
+  const float diagonal_delta = segment.delta.x - segment.delta.z;
+  if (diagonal_delta != 0.0f)
+  {
+    const float t = (ci - cj - (segment.origin.x - segment.origin.z)) / diagonal_delta;
+    if (t > t0 && t < t1)
+      return is_piece_blocked(t0, t) || is_piece_blocked(t, t1);
+  }
+  return is_piece_blocked(t0, t1);
+}
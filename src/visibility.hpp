@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "ZD/3rd/glm/glm.hpp"
+
+#include "gridmap.hpp"
+#include "terrain.hpp"
+
+// line of sight over the triangulated terrain surface of a rectangle of the UNIT grid
+//
+// corner heights are copied once into a min/max pyramid, a segment descends only into the blocks
+// whose highest corner it does not clear and is tested exactly against the two triangles of the cells it reaches,
+// so a query costs about the log of its length, the terrain outside of the rectangle never blocks the sight
+//
+// the pyramid is built by the first query so that creating the visibility costs nothing,
+// it never changes afterwards and any number of threads may query it at once
+class TerrainVisibility final
+{
+public:
+  // cells [i0, i0 + cells_x) x [j0, j0 + cells_z) of the UNIT grid
+  TerrainVisibility(
+    std::shared_ptr<const TerrainField> terrain,
+    const ssize_t i0,
+    const ssize_t j0,
+    const ssize_t cells_x,
+    const ssize_t cells_z);
+
+  // false when the segment goes below the surface anywhere between the points
+  bool line_of_sight(const glm::vec3 &from, const glm::vec3 &to) const;
+  // out[k] is line_of_sight(from[k], to[k]), the queries are split among the hardware threads
+  void line_of_sight_batch(
+    std::span<const glm::vec3> from, std::span<const glm::vec3> to, std::span<uint8_t> out) const;
+
+  // grid map nodes within the distance whose point target_height above the ground is seen from the eye,
+  // nodes lie at (x * spacing.x, z * spacing.y) the same as the paths
+  std::vector<std::pair<int, int>> get_viewshed(
+    const glm::vec3 &eye,
+    const GridMap &grid_map,
+    const glm::vec2 &spacing,
+    const float max_distance,
+    const float target_height) const;
+
+  inline size_t get_levels_count() const
+  {
+    build();
+    return levels.size();
+  }
+  inline size_t get_cells_count() const { return cells_x * cells_z; }
+
+private:
+  // segment in the grid units of the rectangle, y stays in world units
+  struct Segment
+  {
+    glm::vec3 origin;
+    glm::vec3 delta;
+  };
+
+  void build() const;
+  void build_levels() const;
+  bool is_blocked(const Segment &segment, const size_t level, const ssize_t bi, const ssize_t bj) const;
+  bool is_cell_blocked(
+    const Segment &segment, const ssize_t ci, const ssize_t cj, const float t0, const float t1) const;
+
+  inline float corner(const ssize_t ci, const ssize_t cj) const { return heights[cj * (cells_x + 1) + ci]; }
+
+  std::shared_ptr<const TerrainField> terrain;
+  const ssize_t i0, j0;
+  const ssize_t cells_x, cells_z;
+  mutable std::once_flag built;
+  mutable std::vector<float> heights; // (cells_x + 1) * (cells_z + 1) corners, row-major in z
+  // min/max heights over blocks of 2^n cells, the last level is a single block covering the rectangle
+  mutable std::vector<std::vector<glm::vec2>> levels;
+  mutable std::vector<std::pair<ssize_t, ssize_t>> level_sizes;
+};
@@ -1,24 +1,22 @@
 #include "world.hpp"
 #include "mech.hpp"
 #include "prop.hpp"
+#include "debug.hpp"
+#include "cache.hpp"
 
 #include "config.hpp"
 
 void World::generate(const Config &config)
 {
-  mech = std::make_shared<Mech>(glm::vec3 { 2.0, 8.0, 10.0 });
-
-  static std::random_device rd;
-  std::uniform_real_distribution<float> random(0.0f, 1.0f);
+  mech = std::make_shared<Mech>(mech_start);
 
   grid_map = std::make_unique<GridMap>();
-  std::set<std::pair<int, int>> bad_nodes;
+  prop_builder = std::make_unique<PropBuilder>(config.get_props_config());
 
-  PropBuilder prop_builder(config.get_props_config());
-
-  const int PROP_X_SPACING = config.get_world_config()->get_int("PropSpacingX", 2);
-  const int PROP_Z_SPACING = config.get_world_config()->get_int("PropSpacingZ", 4);
-  const float PROP_PROBABILITY = config.get_world_config()->get_float("PropProbability", 0.9);
+  seed = config.get_world_config()->get_int("Seed", seed);
+  prop_x_spacing = config.get_world_config()->get_int("PropSpacingX", prop_x_spacing);
+  prop_z_spacing = config.get_world_config()->get_int("PropSpacingZ", prop_z_spacing);
+  prop_probability = config.get_world_config()->get_float("PropProbability", prop_probability);
   MIN_X = config.get_world_config()->get_int("MinX", -200);
   MAX_X = config.get_world_config()->get_int("MaxX", 200);
   MIN_Z = config.get_world_config()->get_int("MinZ", -200);
@@ -26,31 +24,148 @@ void World::generate(const Config &config)
   X_SPACING = config.get_world_config()->get_float("XSpacing", X_SPACING);
   Z_SPACING = config.get_world_config()->get_float("ZSpacing", Z_SPACING);
 
-  const float normal_factor = config.get_world_config()->get_float("NormalCostFactor", 3.0f);
+  // line of sight covers the MinX..MaxX, MinZ..MaxZ area of the grid nodes, the nodes themselves follow the
+  // streamed chunks, a cell of margin for the jitter of their positions
+  const ssize_t min_i = static_cast<ssize_t>(std::floor(MIN_X * X_SPACING / terrain->UNIT)) - 1;
+  const ssize_t min_j = static_cast<ssize_t>(std::floor(MIN_Z * Z_SPACING / terrain->UNIT)) - 1;
+  const ssize_t max_i = static_cast<ssize_t>(std::ceil(MAX_X * X_SPACING / terrain->UNIT)) + 1;
+  const ssize_t max_j = static_cast<ssize_t>(std::ceil(MAX_Z * Z_SPACING / terrain->UNIT)) + 1;
+  visibility = std::make_unique<TerrainVisibility>(terrain, min_i, min_j, max_i - min_i, max_j - min_j);
+
+  GridMap::CostProfile cost_profile;
+  cost_profile.normal_factor = config.get_world_config()->get_float("NormalCostFactor", cost_profile.normal_factor);
+  mech->set_cost_profile(cost_profile);
+
+  // chunks generated with the same parameters are reused between launches
+  const std::string cache_root = config.get_world_config()->get_string("CacheDirectory", "cache");
+  if (!cache_root.empty())
+  {
+    cache_key = ::cache_key(*config.get_world_config(), config.get_props_config(), config.get_layers_config(), seed);
+    char key_name[17];
+    snprintf(key_name, sizeof(key_name), "%016lx", cache_key);
+    cache_directory = std::filesystem::path(cache_root) / key_name;
+  }
+  ground->set_cache(cache_directory, cache_key);
+
+  update(mech_start);
+}
+
+void World::update(const glm::vec3 &focus)
+{
+  const auto changes = ground->update(focus);
+
+  for (const auto &key : changes.loaded)
+    generate_chunk(key);
+  for (const auto &key : changes.evicted)
+  {
+    // the grid map covers the loaded chunks only, the nodes come back with the chunk
+    const auto [begin_i, end_i, begin_j, end_j] = get_chunk_nodes(key);
+    grid_map->remove(begin_i, end_i, begin_j, end_j);
+    chunk_props.erase(key);
+  }
+
+  if (!changes.loaded.empty() || !changes.evicted.empty())
+    collect_props();
+  update_grid_cubes();
+}
+
+void World::update_grid_cubes()
+{
+  const GridMap::CostProfile &profile = mech->get_cost_profile();
+  if (grid_cubes_profile == profile)
+    return;
+
+  Debug::clear_cubes("Grid");
+  for (const auto &[key, cost] : *grid_map->get_cost_layer(profile))
+  {
+    const float x = key.first * X_SPACING;
+    const float z = key.second * Z_SPACING;
+    Debug::add_cube("Grid", glm::vec3 { x, terrain->get_y(x, z), z });
+  }
+  grid_cubes_profile = profile;
+}
+
+static constexpr uint32_t WORLD_CHUNK_MAGIC { cache_magic("WRLD") };
+
+static std::filesystem::path chunk_file_name(const std::filesystem::path &directory, const Ground::ChunkKey &key)
+{
+  return directory / ("world_" + std::to_string(key.first) + "_" + std::to_string(key.second) + ".bin");
+}
+
+void World::generate_chunk(const Ground::ChunkKey &key)
+{
+  ChunkPopulation population;
+  if (cache_directory.empty() || !read_chunk(key, population))
+  {
+    population = populate_chunk(key);
+    if (!cache_directory.empty())
+      save_chunk(key, population);
+  }
+
+  for (const auto &node : population.nodes)
+    grid_map->add(node.i, node.j, node.slope, node.prop_cost);
+  grid_cubes_profile.reset();
+
+  auto &props_in_chunk = chunk_props[key];
+  for (const auto &placed : population.props)
+  {
+    auto prop = prop_builder->copy(placed.prototype);
+    if (!prop)
+      continue;
+    prop->set_position(placed.position);
+    prop->set_rotation(placed.rotation);
+    props_in_chunk.push_back(std::move(prop));
+  }
+}
+
+std::array<ssize_t, 4> World::get_chunk_nodes(const Ground::ChunkKey &key) const
+{
+  const float min_x = key.first * ground->get_chunk_size();
+  const float min_z = key.second * ground->get_chunk_size();
+  const float max_x = min_x + ground->get_chunk_size();
+  const float max_z = min_z + ground->get_chunk_size();
+  return { static_cast<ssize_t>(std::ceil(min_x / X_SPACING)),
+           static_cast<ssize_t>(std::ceil(max_x / X_SPACING)),
+           static_cast<ssize_t>(std::ceil(min_z / Z_SPACING)),
+           static_cast<ssize_t>(std::ceil(max_z / Z_SPACING)) };
+}
+
+World::ChunkPopulation World::populate_chunk(const Ground::ChunkKey &key) const
+{
+  ChunkPopulation population;
+
+  // every chunk has its own generator so reloaded chunks get the same props
+  std::seed_seq seed_sequence { seed, static_cast<int>(key.first), static_cast<int>(key.second) };
+  std::mt19937 generator(seed_sequence);
+  std::uniform_real_distribution<float> random(0.0f, 1.0f);
+
+  // grid positions inside of the chunk, every streamed chunk has them however far it is
+  const auto [begin_i, end_i, begin_j, end_j] = get_chunk_nodes(key);
 
   // for each position on the map
-  for (ssize_t i = MIN_X; i < MAX_X; i++)
+  for (ssize_t i = begin_i; i < end_i; i++)
   {
-    for (ssize_t j = MIN_Z; j < MAX_Z; j++)
+    for (ssize_t j = begin_j; j < end_j; j++)
     {
       glm::vec3 pos { 0.0, -2.0, 0.0 };
-      pos.x += i * X_SPACING + (random(rd) - 0.5) * X_SPACING / 2.0f;
-      pos.z += j * Z_SPACING + (random(rd) - 0.5) * Z_SPACING / 2.0f;
-      pos.y = ground->get_y(pos.x, pos.z);
+      pos.x += i * X_SPACING + (random(generator) - 0.5) * X_SPACING / 2.0f;
+      pos.z += j * Z_SPACING + (random(generator) - 0.5) * Z_SPACING / 2.0f;
+      pos.y = terrain->get_y(pos.x, pos.z);
 
       // create new empty node at position
-      auto &map_node = grid_map->add(static_cast<int>(i), static_cast<int>(j));
+      auto &node = population.nodes.emplace_back(
+        ChunkNode { .i = static_cast<int32_t>(i), .j = static_cast<int32_t>(j), .slope = 0.0f, .prop_cost = 0.0 });
 
       // calculate normal vector at the position
-      auto n = ground->get_n(pos.x, pos.z);
+      auto n = terrain->get_n(pos.x, pos.z);
       std::shared_ptr<Prop> added_prop;
 
       if (
-        i % PROP_X_SPACING == 0 && j % PROP_Z_SPACING == 0 && random(rd) > (1.0 - PROP_PROBABILITY) &&
-        glm::distance(mech->get_position(), pos) > 5.0f)
+        i % prop_x_spacing == 0 && j % prop_z_spacing == 0 && random(generator) > (1.0 - prop_probability) &&
+        glm::distance(mech_start, pos) > 5.0f)
       {
         // copy random prop available at the position
-        added_prop = prop_builder.copy_at_position(pos);
+        added_prop = prop_builder->copy_at_position(pos, generator);
         if (!added_prop)
         {
           fprintf(stderr, "Cannot create prop at position %f,%f,%f\n", pos.x, pos.y, pos.z);
@@ -61,15 +176,48 @@ void World::generate(const Config &config)
         const float s = sqrt((1.0f + theta) * 2.0f);
         const glm::vec3 a = glm::cross(glm::vec3 { 0.0f, 1.0f, 0.0f }, n);
         auto rot = glm::quat(s * 0.5f, a.x * (1.0f / s), a.y * (1.0f / s), a.z * (1.0f / s));
-        added_prop->set_position(pos);
-        added_prop->set_rotation(rot);
-        props.push_back(added_prop);
+        population.props.push_back(
+          ChunkProp { .prototype = static_cast<uint32_t>(added_prop->prototype), .position = pos, .rotation = rot });
       }
 
-      // calculate node cost
-      map_node.cost = GridMap::Node::calculate_cost(n, normal_factor, added_prop);
+      // store raw node data, costs are derived per agent profile
+      node.slope = GridMap::Node::calculate_slope(n);
+      node.prop_cost = added_prop ? added_prop->cost : 0.0;
     }
   }
 
-  grid_map->clear_bad_nodes(*this);
+  return population;
+}
+
+bool World::read_chunk(const Ground::ChunkKey &key, ChunkPopulation &population) const
+{
+  auto reader = CacheReader::open(chunk_file_name(cache_directory, key), WORLD_CHUNK_MAGIC, cache_key);
+  if (!reader)
+    return false;
+
+  uint32_t nodes_count, props_count;
+  if (!reader->read(nodes_count) || !reader->read(population.nodes, nodes_count))
+    return false;
+  if (!reader->read(props_count) || !reader->read(population.props, props_count))
+    return false;
+  return reader->at_end();
+}
+
+void World::save_chunk(const Ground::ChunkKey &key, const ChunkPopulation &population) const
+{
+  CacheWriter writer(WORLD_CHUNK_MAGIC, cache_key);
+  writer.write(static_cast<uint32_t>(population.nodes.size()));
+  writer.write(population.nodes);
+  writer.write(static_cast<uint32_t>(population.props.size()));
+  writer.write(population.props);
+
+  if (!writer.save(chunk_file_name(cache_directory, key)))
+    fprintf(stderr, "Cannot save world chunk %ld,%ld to the cache\n", key.first, key.second);
+}
+
+void World::collect_props()
+{
+  props.clear();
+  for (const auto &[key, props_in_chunk] : chunk_props)
+    props.insert(props.end(), props_in_chunk.begin(), props_in_chunk.end());
 }
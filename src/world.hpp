@@ -1,7 +1,11 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <map>
 #include <memory>
-#include <set>
+#include <optional>
 #include <unordered_map>
 
 #include "ZD/Color.hpp"
@@ -9,20 +13,28 @@
 
 #include "ground.hpp"
 #include "gridmap.hpp"
+#include "visibility.hpp"
 #include "config.hpp"
 
 class Mech;
 class Prop;
+class PropBuilder;
 
 struct World
 {
   const ZD::Color sky_color { 225, 240, 255 };
+  // shared with the threads querying the terrain
+  std::shared_ptr<const TerrainField> terrain;
   std::unique_ptr<Ground> ground;
   std::vector<std::shared_ptr<Prop>> props;
   std::unique_ptr<GridMap> grid_map;
+  // line of sight over the area of the grid map
+  std::unique_ptr<TerrainVisibility> visibility;
   std::shared_ptr<Mech> mech;
 
   void generate(const Config &config);
+  // streams the ground around the focus point and populates new chunks with grid nodes and props
+  void update(const glm::vec3 &focus);
 
   constexpr const glm::vec3 sky_color_vec() const
   {
@@ -31,10 +43,58 @@ struct World
 
   float X_SPACING { 8.0f };
   float Z_SPACING { 9.0f };
+  // grid node area of the line of sight queries
   ssize_t MIN_X { -70 };
   ssize_t MAX_X { 70 };
   ssize_t MIN_Z { -70 };
   ssize_t MAX_Z { 70 };
 
   friend struct Debug;
+
+private:
+  // grid node and prop of a chunk as stored in the cache
+  // written to the cache as raw bytes, the padding is explicit so that no uninitialized byte is saved
+  struct ChunkNode
+  {
+    int32_t i, j;
+    float slope;
+    uint32_t unused { 0 };
+    double prop_cost;
+  };
+  static_assert(sizeof(ChunkNode) == 24);
+  struct ChunkProp
+  {
+    uint32_t prototype;
+    glm::vec3 position;
+    glm::quat rotation;
+  };
+  struct ChunkPopulation
+  {
+    std::vector<ChunkNode> nodes;
+    std::vector<ChunkProp> props;
+  };
+
+  // adds grid nodes and props of a chunk read from the cache or placed from scratch
+  void generate_chunk(const Ground::ChunkKey &key);
+  ChunkPopulation populate_chunk(const Ground::ChunkKey &key) const;
+  // grid node indices [begin_i, end_i) x [begin_j, end_j) inside of the chunk
+  std::array<ssize_t, 4> get_chunk_nodes(const Ground::ChunkKey &key) const;
+  bool read_chunk(const Ground::ChunkKey &key, ChunkPopulation &population) const;
+  void save_chunk(const Ground::ChunkKey &key, const ChunkPopulation &population) const;
+  void collect_props();
+  // the Grid debug cubes mark the nodes passable for the mech
+  void update_grid_cubes();
+
+  std::unique_ptr<PropBuilder> prop_builder;
+  std::map<Ground::ChunkKey, std::vector<std::shared_ptr<Prop>>> chunk_props;
+  std::optional<GridMap::CostProfile> grid_cubes_profile; // empty when the cubes are out of date
+
+  std::filesystem::path cache_directory;
+  uint64_t cache_key { 0 };
+
+  int seed { 0 };
+  int prop_x_spacing { 2 };
+  int prop_z_spacing { 4 };
+  float prop_probability { 0.9f };
+  const glm::vec3 mech_start { 2.0, 8.0, 10.0 };
 };